@@ -0,0 +1,289 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "simulation.hpp"
+#include "types.hpp"
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+struct Backend {
+	const char *name;
+	NNSChoice   choice;
+};
+
+// results of one experiment under one backend
+struct Result {
+	int    cells;       // cells after the last iteration
+	double cell_steps;  // sum of cells processed by each iteration
+	double seconds;     // wall time of the iterations, without parsing and setup
+	long   peak_rss;    // in kB
+	double phases[N_PHASES]; // total ms of each phase, from a separate profiled run
+	double step_ms;
+};
+
+/*-------------------------------- LOCAL VARIABLES --------------------------------*/
+
+static const Backend backends[] = {
+	{"auto", AUTO},
+	{"ss",   SPATIAL_SORTING},
+	{"kd",   KD_TREE},
+	{"grid", CELL_LIST}
+};
+
+static const int N_BACKENDS = sizeof(backends) / sizeof(backends[0]);
+
+// default suite: reaction-diffusion on fixed tissues, automata, and a few growing tissues
+static const char *default_patterns[] = {
+	"basic-turing/turing-01-initial-concentrations.pat",
+	"basic-diffusion/diffusion-03-single-producer.pat",
+	"basic-anisotropy/anisotropy-01-both-reagents.pat",
+	"basic-modulation/modulation-01-concentric-circles.pat",
+	"automata-distance/distance-02-chessboard.pat",
+	"growth-uniform/uniform-04-random-seeds.pat",
+	"supplement/08-front-growth.pat",
+	"supplement/20-saturated-leopard.pat"
+};
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+// runs in a child process, so every experiment starts from a clean simulation state and has its own peak RSS;
+// results are written as a single line to 'fd'
+
+static void run_child(const char *pattern, NNSChoice choice, int iterations, int n_threads, bool profile, int fd)
+{
+	// keep the output of the parser and the simulation out of the report
+	int null_fd = open("/dev/null", O_WRONLY);
+	if (null_fd != -1) {
+		dup2(null_fd, STDOUT_FILENO);
+		close(null_fd);
+	}
+
+	parser_init(pattern);
+	parser_load_pattern();
+	simulation.stop_at = -1; // all experiments run for the same number of iterations
+
+	if (profile) {
+		simulation_use_profiler();
+	}
+	simulation_init(choice, false, n_threads);
+
+	double cell_steps = 0;
+	double start = Profiler::now();
+	for (int i = 0; i < iterations; i++) {
+		cell_steps += simulation.n_cells;
+		simulation_run(1);
+	}
+	double seconds = (Profiler::now() - start) / 1000;
+
+	std::ostringstream out;
+	out.precision(12);
+	out << simulation.n_cells << ' ' << cell_steps << ' ' << seconds;
+	const Profiler& profiler = simulation_get_profiler();
+	for (int p = 0; p < N_PHASES; p++) {
+		out << ' ' << profiler.get_total(p);
+	}
+	out << ' ' << profiler.get_step_total() << '\n';
+
+	std::string line = out.str();
+	if (write(fd, line.c_str(), line.size()) != (ssize_t) line.size()) {
+		exit(1);
+	}
+	simulation_done();
+	exit(0);
+}
+
+// runs one experiment in a child process; false if it failed
+
+static bool run(const char *pattern, NNSChoice choice, int iterations, int n_threads, bool profile, Result& result)
+{
+	int fds[2];
+	if (pipe(fds) == -1) {
+		std::cerr << "error: could not create pipe\n";
+		exit(1);
+	}
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid == -1) {
+		std::cerr << "error: could not fork\n";
+		exit(1);
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		run_child(pattern, choice, iterations, n_threads, profile, fds[1]);
+	}
+	close(fds[1]);
+
+	std::string line;
+	char buffer[256];
+	ssize_t n;
+	while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+		line.append(buffer, n);
+	}
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || line.empty()) {
+		return false;
+	}
+
+	std::istringstream in(line);
+	double phases[N_PHASES];
+	double step_ms;
+	in >> result.cells >> result.cell_steps >> result.seconds;
+	for (int p = 0; p < N_PHASES; p++) {
+		in >> phases[p];
+	}
+	in >> step_ms;
+
+	if (profile) {
+		std::copy(phases, phases + N_PHASES, result.phases);
+		result.step_ms = step_ms;
+	}
+	else {
+		result.peak_rss = usage.ru_maxrss; // kB on Linux
+	}
+	return true;
+}
+
+static NNSChoice parse_backend(const std::string& name)
+{
+	for (int b = 0; b < N_BACKENDS; b++) {
+		if (name == backends[b].name) {
+			return backends[b].choice;
+		}
+	}
+	std::cout << "error: unknown backend '" << name << "'\n";
+	exit(1);
+}
+
+/*-------------------------------- MAIN FUNCTION --------------------------------*/
+
+int main(int argc, char *argv[])
+{
+    argv++; argc--;
+
+    int iterations = 200;
+    int n_threads = 1;
+    bool profile = true;
+    const char *csv_name = "bench.csv";
+    std::vector<std::string> backend_names;
+    for (int b = 0; b < N_BACKENDS; b++) {
+    	backend_names.push_back(backends[b].name);
+    }
+
+    while (argc > 0 && (*argv)[0] == '-') {
+    	if (strcmp(*argv, "--iterations") == 0 && argc > 1) {
+    		argv++; argc--;
+    		iterations = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--threads") == 0 && argc > 1) {
+    		argv++; argc--;
+    		n_threads = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--nns") == 0 && argc > 1) {
+    		argv++; argc--;
+    		backend_names.clear();
+    		std::istringstream list(*argv);
+    		std::string name;
+    		while (std::getline(list, name, ',')) {
+    			parse_backend(name);
+    			backend_names.push_back(name);
+    		}
+    	}
+    	else if (strcmp(*argv, "--csv") == 0 && argc > 1) {
+    		argv++; argc--;
+    		csv_name = *argv;
+    	}
+    	else if (strcmp(*argv, "--nophases") == 0) {
+    		profile = false;
+    	}
+    	else {
+    		std::cout << "usage: bench [OPTION] [FILE.pat ...]\n";
+    		std::cout << "  --iterations N  iterations of each experiment (default 200)\n";
+    		std::cout << "  --threads N     run each step on N threads (default 1)\n";
+    		std::cout << "  --nns LIST      comma-separated backends among auto,ss,kd,grid (default all)\n";
+    		std::cout << "  --csv FILE      write results to FILE (default bench.csv)\n";
+    		std::cout << "  --nophases      skip the profiled run that measures time per phase\n";
+    		std::cout << "without files, runs a default suite of experiments from the current directory\n";
+    		std::cout << '\n';
+    		exit(1);
+    	}
+    	argv++; argc--;
+    }
+
+    std::vector<std::string> patterns;
+    for (int i = 0; i < argc; i++) {
+    	patterns.push_back(argv[i]);
+    }
+    if (patterns.empty()) {
+    	patterns.assign(default_patterns, default_patterns + sizeof(default_patterns) / sizeof(default_patterns[0]));
+    }
+
+    std::ofstream csv(csv_name);
+    if (!csv) {
+    	std::cout << "error: could not open '" << csv_name << "'\n";
+    	exit(1);
+    }
+    csv << "pattern,nns,threads,iterations,cells,seconds,iter_per_s,cell_iter_per_s,peak_rss_kb";
+    for (int p = 0; p < N_PHASES; p++) {
+    	csv << ',' << Profiler::get_phase_key(p) << "_ms";
+    }
+    csv << ",step_ms\n";
+
+    printf("%-55s %-5s %8s %10s %14s %10s\n", "pattern", "nns", "cells", "iter/s", "cell*iter/s", "rss kB");
+
+    int failed = 0;
+    for (int f = 0; f < (int) patterns.size(); f++) {
+    	for (int b = 0; b < (int) backend_names.size(); b++) {
+    		const char *pattern = patterns[f].c_str();
+    		NNSChoice choice = parse_backend(backend_names[b]);
+
+    		// throughput is measured without profiling, as timing each cell costs about as much as processing it
+    		Result result;
+    		std::fill(result.phases, result.phases + N_PHASES, 0.0);
+    		result.step_ms = 0;
+    		if (!run(pattern, choice, iterations, n_threads, false, result) ||
+    				(profile && !run(pattern, choice, iterations, n_threads, true, result))) {
+    			printf("%-55s %-5s failed\n", pattern, backend_names[b].c_str());
+    			failed++;
+    			continue;
+    		}
+
+    		double iter_per_s = (result.seconds > 0) ? iterations / result.seconds : 0;
+    		double cell_iter_per_s = (result.seconds > 0) ? result.cell_steps / result.seconds : 0;
+    		printf("%-55s %-5s %8d %10.1f %14.0f %10ld\n", pattern, backend_names[b].c_str(), result.cells, iter_per_s, cell_iter_per_s, result.peak_rss);
+    		fflush(stdout);
+
+    		char line[200];
+    		snprintf(line, sizeof(line), "%s,%s,%d,%d,%d,%.4f,%.2f,%.0f,%ld", pattern, backend_names[b].c_str(), n_threads, iterations,
+    				result.cells, result.seconds, iter_per_s, cell_iter_per_s, result.peak_rss);
+    		csv << line;
+    		for (int p = 0; p < N_PHASES; p++) {
+    			snprintf(line, sizeof(line), ",%.3f", result.phases[p]);
+    			csv << line;
+    		}
+    		snprintf(line, sizeof(line), ",%.3f\n", result.step_ms);
+    		csv << line;
+    	}
+    }
+
+    std::cout << "results written to " << csv_name << '\n';
+    return failed ? 1 : 0;
+}
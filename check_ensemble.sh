@@ -0,0 +1,31 @@
+#!/bin/sh
+# checks that a member of an ensemble with seed S ends as a single run of the same pattern with every seed set to S
+#
+#   ./check_ensemble.sh SEED ITERATIONS FILE.pat...
+
+seed=$1
+iterations=$2
+shift 2
+tmp=${TMPDIR:-/tmp}/check-ensemble-$$
+status=0
+
+for pattern in "$@"; do
+	# both runs stop after the same number of iterations; the single run gets the seed from its first line
+	grep -v "^stop at" "$pattern" > $tmp-member.pat
+	echo "stop at $iterations" >> $tmp-member.pat
+	{ echo "use seed $seed"; sed "s/^use seed .*/use seed $seed/" $tmp-member.pat; } > $tmp-single.pat
+
+	member=$(./offline --ensemble 1 --seed $seed $tmp-member.pat | grep "^seed ")
+	single=$(./offline $tmp-single.pat | grep "^seed ")
+	if [ "$member" = "$single" ]; then
+		echo "ok: $pattern"
+	else
+		echo "error: $pattern"
+		echo "  ensemble: $member"
+		echo "  single:   $single"
+		status=1
+	fi
+done
+
+rm -f $tmp-member.pat $tmp-single.pat
+exit $status
@@ -0,0 +1,266 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "nns_base.hpp"
+
+#include "checkpoint.hpp"
+
+/*-------------------------------- MACRO DEFINITIONS --------------------------------*/
+
+// files are only meant to be read by the same build on the same machine, so values are written in memory layout
+#define CHECKPOINT_MAGIC   "PEXCKPT"
+#define CHECKPOINT_VERSION 2
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+template <class T>
+static void put(std::ostream& out, const T& value)
+{
+	out.write((const char*) &value, sizeof(T));
+}
+
+template <class T>
+static void put_array(std::ostream& out, const T *values, int n)
+{
+	out.write((const char*) values, n * sizeof(T));
+}
+
+static void put_string(std::ostream& out, const std::string& s)
+{
+	put(out, (int) s.size());
+	out.write(s.data(), s.size());
+}
+
+template <class T>
+static void put_vector(std::ostream& out, const std::vector<T>& values)
+{
+	put(out, (int) values.size());
+	put_array(out, values.data(), values.size());
+}
+
+template <class T>
+static void get(std::istream& in, T& value)
+{
+	in.read((char*) &value, sizeof(T));
+}
+
+template <class T>
+static void get_array(std::istream& in, T *values, int n)
+{
+	in.read((char*) values, n * sizeof(T));
+}
+
+static void get_string(std::istream& in, std::string& s)
+{
+	int n = 0;
+	get(in, n);
+	if (in && n >= 0) {
+		s.resize(n);
+		in.read(&s[0], n);
+	}
+}
+
+template <class T>
+static void get_vector(std::istream& in, std::vector<T>& values)
+{
+	int n = 0;
+	get(in, n);
+	if (in && n >= 0) {
+		values.resize(n);
+		get_array(in, values.data(), n);
+	}
+}
+
+// attributes of the first 'n' cells; 'next_cells' is not saved, as each step rebuilds it from 'curr_cells'
+
+static void put_cells(std::ostream& out, const CellArray& cells, int n, int n_chemicals)
+{
+	put_array(out, cells.birth, n);
+	put_array(out, cells.neighbors, n);
+	put_array(out, cells.x, n);
+	put_array(out, cells.y, n);
+	put_array(out, cells.polarity_x, n);
+	put_array(out, cells.polarity_y, n);
+	for (int ch = 0; ch < n_chemicals; ch++) {
+		put_array(out, cells.conc[ch], n);
+		put_array(out, cells.diff[ch], n);
+	}
+	put_array(out, cells.fixed, n);
+	put_array(out, cells.marker, n);
+}
+
+static void get_cells(std::istream& in, CellArray& cells, int n, int n_chemicals)
+{
+	get_array(in, cells.birth, n);
+	get_array(in, cells.neighbors, n);
+	get_array(in, cells.x, n);
+	get_array(in, cells.y, n);
+	get_array(in, cells.polarity_x, n);
+	get_array(in, cells.polarity_y, n);
+	for (int ch = 0; ch < n_chemicals; ch++) {
+		get_array(in, cells.conc[ch], n);
+		get_array(in, cells.diff[ch], n);
+	}
+	get_array(in, cells.fixed, n);
+	get_array(in, cells.marker, n);
+}
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+bool checkpoint_save(const SimulationContext& context, const char *filename)
+{
+	const Simulation& simulation = context.simulation;
+
+	std::string temp_name = std::string(filename) + ".tmp";
+	std::ofstream out(temp_name.c_str(), std::ios::binary);
+	if (!out) {
+		return false;
+	}
+
+	out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	put(out, (int) CHECKPOINT_VERSION);
+
+	// simulation
+	put(out, simulation.n_cells);
+	put(out, simulation.n_chemicals);
+	put(out, simulation.division_limit);
+	put(out, simulation.domain_xmin);
+	put(out, simulation.domain_xmax);
+	put(out, simulation.domain_ymin);
+	put(out, simulation.domain_ymax);
+	put(out, simulation.domain_is_packed);
+	put(out, simulation.domain_packed_factor);
+	put(out, simulation.is_running);
+	put(out, simulation.iteration);
+	put(out, simulation.time_step);
+	put(out, simulation.seed);
+	put(out, simulation.mirroring);
+	put(out, simulation.exit_at_end);
+	put(out, simulation.stop_at);
+	put(out, simulation.texture_width);
+	put(out, simulation.texture_height);
+	put(out, simulation.zoom_level);
+	put(out, simulation.is_stable);
+
+	for (int ch = 0; ch < simulation.n_chemicals; ch++) {
+		put_string(out, simulation.chemicals[ch].name);
+		put(out, simulation.chemicals[ch].limit);
+		put(out, simulation.chemicals[ch].anisotropic);
+	}
+	put_cells(out, simulation.curr_cells, simulation.n_cells, simulation.n_chemicals);
+
+	put_vector(out, simulation.rules);
+	put(out, (int) simulation.mappings.size());
+	for (int m = 0; m < (int) simulation.mappings.size(); m++) {
+		put_string(out, simulation.mappings[m]);
+	}
+	put_vector(out, simulation.mirror_list);
+	put_vector(out, simulation.snap_at);
+
+	// setup state, so that cells created after restoring get the same attributes and random values
+	put(out, context.cell_parameters);
+	put(out, context.random);
+	put(out, context.any_anisotropic);
+	put(out, context.nns_dim_x);
+	put(out, context.nns_dim_y);
+	put(out, context.nns_wrap);
+	put(out, context.reorder_locality);
+
+	// order of positions in the NNS: spatial sorting keeps improving it from step to step, and divisions are merged
+	// in this order, so restoring it lets the run continue exactly as if it had not been interrupted
+	std::vector<CellId> nns_order;
+	if (context.nns) {
+		int n = context.nns->get_position_count();
+		for (int index = 0; index < n; index++) {
+			nns_order.push_back(context.nns->get_cell_id(index));
+		}
+	}
+	put_vector(out, nns_order);
+
+	out.close();
+	if (!out) {
+		remove(temp_name.c_str());
+		return false;
+	}
+	return rename(temp_name.c_str(), filename) == 0;
+}
+
+bool checkpoint_load(SimulationContext& context, const char *filename)
+{
+	Simulation& simulation = context.simulation;
+
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) {
+		return false;
+	}
+
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	int version = 0;
+	in.read(magic, sizeof(magic));
+	get(in, version);
+	if (!in || std::string(magic) != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION) {
+		return false;
+	}
+
+	int n_cells = 0, n_chemicals = 0;
+	get(in, n_cells);
+	get(in, n_chemicals);
+	if (!in || n_cells < 0 || n_chemicals < 0 || n_chemicals > MAX_CHEMICALS) {
+		return false;
+	}
+	get(in, simulation.division_limit);
+	get(in, simulation.domain_xmin);
+	get(in, simulation.domain_xmax);
+	get(in, simulation.domain_ymin);
+	get(in, simulation.domain_ymax);
+	get(in, simulation.domain_is_packed);
+	get(in, simulation.domain_packed_factor);
+	get(in, simulation.is_running);
+	get(in, simulation.iteration);
+	get(in, simulation.time_step);
+	get(in, simulation.seed);
+	get(in, simulation.mirroring);
+	get(in, simulation.exit_at_end);
+	get(in, simulation.stop_at);
+	get(in, simulation.texture_width);
+	get(in, simulation.texture_height);
+	get(in, simulation.zoom_level);
+	get(in, simulation.is_stable);
+
+	for (int ch = 0; ch < n_chemicals; ch++) {
+		simulation.new_chemical();
+		get_string(in, simulation.chemicals[ch].name);
+		get(in, simulation.chemicals[ch].limit);
+		get(in, simulation.chemicals[ch].anisotropic);
+	}
+	simulation.curr_cells.reserve(n_cells);
+	simulation.next_cells.reserve(n_cells);
+	simulation.n_cells = n_cells;
+	get_cells(in, simulation.curr_cells, n_cells, n_chemicals);
+
+	get_vector(in, simulation.rules);
+	int n_mappings = 0;
+	get(in, n_mappings);
+	for (int m = 0; in && m < n_mappings; m++) {
+		std::string name;
+		get_string(in, name);
+		simulation.mappings.push_back(name);
+	}
+	get_vector(in, simulation.mirror_list);
+	get_vector(in, simulation.snap_at);
+
+	get(in, context.cell_parameters);
+	get(in, context.random);
+	get(in, context.any_anisotropic);
+	get(in, context.nns_dim_x);
+	get(in, context.nns_dim_y);
+	get(in, context.nns_wrap);
+	get(in, context.reorder_locality);
+	get_vector(in, context.nns_order);
+
+	return (bool) in;
+}
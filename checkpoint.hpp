@@ -0,0 +1,18 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "simulation.hpp"
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+// writes the state of 'context' between two steps to 'filename', through a temporary file so that an interrupted
+// write leaves the previous checkpoint intact; false if it could not be written
+bool checkpoint_save(const SimulationContext& context, const char *filename);
+
+// sets up 'context', which must be new, from 'filename' instead of a pattern file; simulation_init is then called as
+// usual, and the simulation continues from the saved iteration; false if it could not be read
+bool checkpoint_load(SimulationContext& context, const char *filename);
+
+#endif // CHECKPOINT_HPP
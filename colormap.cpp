@@ -323,18 +323,28 @@ void colormap_set_limits(float min, float max)
 	value_range = max - min;
 }
 
-float* colormap_lookup(float val)
+static float* lookup(float val, float min, float range)
 {
-	if (value_range < 0.0001) {
+	if (range < 0.0001) {
 		// HACK: exit simulation to speed up
 		//exit(0);
 		// range is too small: color everything with 50% gray
 		return gray;
 	}
-	int i = int(99 * (val - value_min) / value_range);
+	int i = int(99 * (val - min) / range);
 	if (i < 0 || i > 99) {
 		//std::cout << "OVER val=" << val << " i=" << i << '\n';
 		return gray;
 	}
 	return &current[i * 3];
 }
+
+float* colormap_lookup(float val)
+{
+	return lookup(val, value_min, value_range);
+}
+
+float* colormap_lookup(float val, float min, float max)
+{
+	return lookup(val, min, max - min);
+}
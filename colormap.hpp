@@ -23,4 +23,7 @@ void colormap_set_limits(float min, float max);
 
 float* colormap_lookup(float val);
 
+// same as above with its own limits instead of those of colormap_set_limits, so it can be called from any thread
+float* colormap_lookup(float val, float min, float max);
+
 #endif // COLORMAP_HPP
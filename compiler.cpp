@@ -0,0 +1,245 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "compiler.hpp"
+
+/*-------------------------------- CONSTRUCTOR --------------------------------*/
+
+Program::Program()
+{
+	n_registers = REG_CONSTANTS;
+	uses_cell_attributes = false;
+}
+
+/*-------------------------------- COMPILATION --------------------------------*/
+
+void Program::compile(const std::vector<Rule>& rules)
+{
+	this->rules = rules;
+	constants.clear();
+	conditions.clear();
+	instructions.clear();
+	code.clear();
+	in_window.clear();
+	uses_cell_attributes = false;
+
+	for (int r = 0; r < (int) rules.size(); r++) {
+		conditions.push_back(get_condition(rules[r], r));
+		instructions.push_back(get_instruction(rules[r], r));
+	}
+	n_registers = REG_CONSTANTS + (int) constants.size();
+}
+
+// operands that are variables already have their register; constants are stored once and shared
+int Program::get_register(Parameter par, float val)
+{
+	if (par == CONSTANT) {
+		for (int i = 0; i < (int) constants.size(); i++) {
+			if (constants[i] == val) {
+				return REG_CONSTANTS + i;
+			}
+		}
+		constants.push_back(val);
+		return REG_CONSTANTS + (int) constants.size() - 1;
+	}
+	else if (par == NEIGHBORS) {
+		uses_cell_attributes = true;
+		return REG_NEIGHBORS;
+	}
+	else if (par == AGE) {
+		uses_cell_attributes = true;
+		return REG_AGE;
+	}
+	else if (par == BIRTH) {
+		uses_cell_attributes = true;
+		return REG_BIRTH;
+	}
+	return (int) par;
+}
+
+Condition Program::get_condition(const Rule& rule, int r)
+{
+	Condition c;
+	c.predicate = rule.predicate;
+	c.rule = r;
+	for (int i = 0; i < 3; i++) {
+		c.op[i] = get_register(rule.pr_par[i], rule.pr_val[i]);
+	}
+
+	// fold comparisons between constants
+	bool constant = (rule.pr_par[0] == CONSTANT && rule.pr_par[1] == CONSTANT);
+	float a = rule.pr_val[0], b = rule.pr_val[1];
+	bool value = false;
+	switch (rule.predicate) {
+	case ALWAYS:
+		return c;
+	case IF_EQUAL:         value = (a == b); break;
+	case IF_NOT_EQUAL:     value = (a != b); break;
+	case IF_LESS_THAN:     value = (a <  b); break;
+	case IF_LESS_EQUAL:    value = (a <= b); break;
+	case IF_GREATER_THAN:  value = (a >  b); break;
+	case IF_GREATER_EQUAL: value = (a >= b); break;
+	case IF_IN_INTERVAL:
+		constant = constant && (rule.pr_par[2] == CONSTANT);
+		value = (b <= a && a <= rule.pr_val[2]);
+		break;
+	case PROBABILITY:
+		// draws are independent of each other, so there is no need to draw when the outcome is certain
+		if (rule.pr_par[0] != CONSTANT || (a >= 0 && a < 1)) {
+			return c;
+		}
+		constant = true;
+		value = (a >= 1);
+		break;
+	default:
+		std::cout << "unknown predicate in rule " << r << '\n';
+		exit(1);
+	}
+	if (constant) {
+		c.predicate = value ? ALWAYS : NEVER;
+	}
+	return c;
+}
+
+Instruction Program::get_instruction(const Rule& rule, int r)
+{
+	Instruction in;
+	in.rule = r;
+	in.action = rule.action;
+	for (int i = 0; i < MAX_PARAMETERS; i++) {
+		in.op[i] = get_register(rule.ac_par[i], rule.ac_val[i]);
+	}
+	in.map_source[0] = in.map_source[1] = in.map_target[0] = in.map_target[1] = 0;
+	in.map_source_width = in.map_target_width = 0;
+	in.constant = (rule.ac_par[2] == CONSTANT && rule.ac_par[3] == CONSTANT && rule.ac_par[4] == CONSTANT && rule.ac_par[5] == CONSTANT);
+
+	switch (rule.action) {
+	case REACT_GS:
+	case REACT_TU:
+	case REACT_LI:
+	case REACT_CU:
+	case CHANGE:
+	case POLARIZE:
+	case DIVIDE:
+	case MOVE:
+	case AND:
+		break;
+	case MAP:
+		in.map_source[0] = rule.ac_val[1];
+		in.map_source[1] = rule.ac_val[2];
+		in.map_target[0] = rule.ac_val[4];
+		in.map_target[1] = rule.ac_val[5];
+		in.map_source_width = rule.ac_val[2] - rule.ac_val[1];
+		in.map_target_width = rule.ac_val[5] - rule.ac_val[4];
+		break;
+	default:
+		std::cout << "unknown action in rule " << r << '\n';
+		exit(1);
+	}
+	return in;
+}
+
+/*-------------------------------- SELECTION --------------------------------*/
+
+bool Program::select(int iteration)
+{
+	std::vector<bool> window(rules.size());
+	for (int r = 0; r < (int) rules.size(); r++) {
+		window[r] = (rules[r].from <= iteration && iteration <= rules[r].until);
+	}
+	if (window == in_window) {
+		return false;
+	}
+	in_window = window;
+	code.clear();
+	reactions.clear();
+	reacted.clear();
+
+	// conditions of consecutive rules joined by AND form a chain that guards the action of the last rule; chains
+	// that can never hold are dropped
+	std::vector<Condition> chain;
+	bool open = false;
+
+	for (int r = 0; r < (int) rules.size(); r++) {
+		const Rule& rule = rules[r];
+
+		if (!window[r]) {
+			if (rule.action == AND) {
+				// even if outside the interval, an AND makes the next rule(s) false
+				chain.clear();
+				Condition never;
+				never.predicate = NEVER;
+				never.rule = r;
+				never.op[0] = never.op[1] = never.op[2] = 0;
+				chain.push_back(never);
+				open = true;
+			}
+			continue;
+		}
+
+		if (!open) {
+			chain.clear();
+		}
+		const Condition& c = conditions[r];
+		if (c.predicate != ALWAYS) {
+			chain.push_back(c);
+		}
+
+		if (rule.action == AND) {
+			open = true;
+			continue;
+		}
+		open = false;
+
+		Instruction in = instructions[r];
+		in.conditions = chain;
+
+		bool never = false;
+		for (int i = 0; i < (int) in.conditions.size(); i++) {
+			if (in.conditions[i].predicate == NEVER) {
+				never = true;
+			}
+		}
+		if (never) {
+			continue;
+		}
+		if (is_tissue_reaction(in)) {
+			reactions.push_back(in);
+			for (int i = 0; i < 2; i++) {
+				if (i == 0 || in.action == REACT_GS || in.action == REACT_TU) {
+					if (std::find(reacted.begin(), reacted.end(), in.op[i]) == reacted.end()) {
+						reacted.push_back(in.op[i]);
+					}
+				}
+			}
+		}
+		else {
+			code.push_back(in);
+		}
+	}
+	return true;
+}
+
+// a reaction can run over the whole tissue, before the other rules, when it always happens and its parameters are
+// concentrations, diffusion rates or constants, none of which depends on earlier rules of the cell
+bool Program::is_tissue_reaction(const Instruction& in) const
+{
+	if (in.action != REACT_GS && in.action != REACT_TU && in.action != REACT_LI && in.action != REACT_CU) {
+		return false;
+	}
+	if (!in.conditions.empty()) {
+		return false;
+	}
+	if ((in.action == REACT_GS || in.action == REACT_TU) && in.op[0] == in.op[1]) {
+		return false; // both terms would go to the same chemical
+	}
+	for (int i = 2; i < MAX_PARAMETERS; i++) {
+		if (in.op[i] >= 2 * MAX_CHEMICALS && in.op[i] < REG_CONSTANTS) {
+			return false; // mapped values depend on earlier rules, and integer cell attributes are left to the rule loop
+		}
+	}
+	return true;
+}
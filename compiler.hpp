@@ -0,0 +1,73 @@
+#ifndef COMPILER_HPP
+#define COMPILER_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <vector>
+
+#include "types.hpp"
+
+/*-------------------------------- MACRO DEFINITIONS --------------------------------*/
+
+// every operand of a compiled rule is an index into a per-cell register file; registers of concentrations, diffusion
+// rates and mapped values use the same numbering as 'Parameter', followed by the cell attributes and the constants
+
+#define REG_NEIGHBORS (2 * MAX_CHEMICALS + MAX_MAPPINGS)
+#define REG_AGE       (REG_NEIGHBORS + 1)
+#define REG_BIRTH     (REG_NEIGHBORS + 2)
+#define REG_CONSTANTS (REG_NEIGHBORS + 3)
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+class Condition {
+public:
+	Predicate predicate; // NEVER stands for a chain that is false, e.g. after an AND outside its interval
+	int       rule;      // index of the source rule, which identifies its random numbers
+	int       op[3];
+};
+
+// one action together with the fused chain of all predicates that must hold for it to happen
+class Instruction {
+public:
+	std::vector<Condition> conditions;
+	int    rule; // index of the source rule of the action
+	Action action;
+	int    op[MAX_PARAMETERS];
+	float  map_source[2], map_target[2];  // 'map' intervals
+	float  map_source_width, map_target_width;
+	bool   constant; // all parameters of a reaction are constants
+};
+
+class Program {
+public:
+	std::vector<float> constants;  // registers from REG_CONSTANTS onwards
+	std::vector<Rule>  rules;      // source rules
+	std::vector<Instruction> code; // instructions for the current iteration
+	std::vector<Instruction> reactions; // unconditional reactions of the current iteration, run over the whole tissue
+	std::vector<int> reacted;           // chemicals changed by 'reactions'
+
+	int  n_registers;
+	bool uses_cell_attributes; // any operand is the number of neighbors, the age or the birth of the cell
+
+private:
+	std::vector<Condition>   conditions;   // compiled predicate of each rule
+	std::vector<Instruction> instructions; // compiled action of each rule
+	std::vector<bool>        in_window;    // rules within their interval when 'code' was generated
+
+public:
+	Program();
+
+	// translate rules, exiting on rules that cannot be evaluated
+	void compile(const std::vector<Rule>& rules);
+
+	// generate the code for 'iteration', dropping rules outside their interval; returns true if the code changed
+	bool select(int iteration);
+
+private:
+	int get_register(Parameter par, float val);
+	bool is_tissue_reaction(const Instruction& in) const;
+	Condition get_condition(const Rule& rule, int r);
+	Instruction get_instruction(const Rule& rule, int r);
+};
+
+#endif // COMPILER_HPP
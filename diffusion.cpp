@@ -0,0 +1,173 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <pthread.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DIFFUSION_X86
+#endif
+
+#include "diffusion.hpp"
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+typedef float (*DiffusionKernel)(const float *conc, const float *diff, const int *ids, const float *weights, int n, float curr_conc, float curr_diff);
+
+// all kernels add the terms in the same order, so that results do not depend on the CPU: term k goes to lane k % 8 of
+// 8 partial sums while whole groups of 8 are left, lanes j and j + 4 are added, then pairs of those, and the remaining
+// terms are added one by one
+
+/*-------------------------------- SCALAR KERNELS --------------------------------*/
+
+// adds the terms of neighbors [k, n) one by one to 'sum'
+static inline float add_terms(float sum, const float *conc, const float *diff, const int *ids, const float *weights, int k, int n, float curr_conc, float curr_diff)
+{
+	if (weights) {
+		for (; k < n; k++) {
+			sum += std::min(diff[ids[k]], curr_diff) * (conc[ids[k]] - curr_conc) * weights[k];
+		}
+	}
+	else {
+		for (; k < n; k++) {
+			sum += std::min(diff[ids[k]], curr_diff) * (conc[ids[k]] - curr_conc);
+		}
+	}
+	return sum;
+}
+
+static float sum_scalar(const float *conc, const float *diff, const int *ids, const float *weights, int n, float curr_conc, float curr_diff)
+{
+	float lanes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+	int k = 0;
+	for (; k + 8 <= n; k += 8) {
+		for (int j = 0; j < 8; j++) {
+			float t = std::min(diff[ids[k + j]], curr_diff) * (conc[ids[k + j]] - curr_conc);
+			if (weights) {
+				t *= weights[k + j];
+			}
+			lanes[j] += t;
+		}
+	}
+
+	float half[4];
+	for (int j = 0; j < 4; j++) {
+		half[j] = lanes[j] + lanes[j + 4];
+	}
+	float sum = (half[0] + half[1]) + (half[2] + half[3]);
+
+	return add_terms(sum, conc, diff, ids, weights, k, n, curr_conc, curr_diff);
+}
+
+#ifdef DIFFUSION_X86
+
+/*-------------------------------- SSE KERNEL --------------------------------*/
+
+// SSE has no gather, so neighbor values are loaded one by one into the lanes; two registers hold the 8 partial sums
+
+__attribute__((target("sse2")))
+static float sum_sse(const float *conc, const float *diff, const int *ids, const float *weights, int n, float curr_conc, float curr_diff)
+{
+	__m128 cc = _mm_set1_ps(curr_conc);
+	__m128 cd = _mm_set1_ps(curr_diff);
+	__m128 acc_lo = _mm_setzero_ps();
+	__m128 acc_hi = _mm_setzero_ps();
+
+	int k = 0;
+	for (; k + 8 <= n; k += 8) {
+		__m128 nc = _mm_set_ps(conc[ids[k + 3]], conc[ids[k + 2]], conc[ids[k + 1]], conc[ids[k]]);
+		__m128 nd = _mm_set_ps(diff[ids[k + 3]], diff[ids[k + 2]], diff[ids[k + 1]], diff[ids[k]]);
+		__m128 t = _mm_mul_ps(_mm_min_ps(nd, cd), _mm_sub_ps(nc, cc));
+		if (weights) {
+			t = _mm_mul_ps(t, _mm_loadu_ps(weights + k));
+		}
+		acc_lo = _mm_add_ps(acc_lo, t);
+
+		nc = _mm_set_ps(conc[ids[k + 7]], conc[ids[k + 6]], conc[ids[k + 5]], conc[ids[k + 4]]);
+		nd = _mm_set_ps(diff[ids[k + 7]], diff[ids[k + 6]], diff[ids[k + 5]], diff[ids[k + 4]]);
+		t = _mm_mul_ps(_mm_min_ps(nd, cd), _mm_sub_ps(nc, cc));
+		if (weights) {
+			t = _mm_mul_ps(t, _mm_loadu_ps(weights + k + 4));
+		}
+		acc_hi = _mm_add_ps(acc_hi, t);
+	}
+
+	float half[4];
+	_mm_storeu_ps(half, _mm_add_ps(acc_lo, acc_hi));
+	float sum = (half[0] + half[1]) + (half[2] + half[3]);
+
+	return add_terms(sum, conc, diff, ids, weights, k, n, curr_conc, curr_diff);
+}
+
+/*-------------------------------- AVX2 KERNEL --------------------------------*/
+
+__attribute__((target("avx2")))
+static float sum_avx2(const float *conc, const float *diff, const int *ids, const float *weights, int n, float curr_conc, float curr_diff)
+{
+	__m256 cc = _mm256_set1_ps(curr_conc);
+	__m256 cd = _mm256_set1_ps(curr_diff);
+	__m256 acc = _mm256_setzero_ps();
+
+	int k = 0;
+	for (; k + 8 <= n; k += 8) {
+		__m256i idx = _mm256_loadu_si256((const __m256i*) (ids + k));
+		__m256 nc = _mm256_i32gather_ps(conc, idx, 4);
+		__m256 nd = _mm256_i32gather_ps(diff, idx, 4);
+		__m256 t = _mm256_mul_ps(_mm256_min_ps(nd, cd), _mm256_sub_ps(nc, cc));
+		if (weights) {
+			t = _mm256_mul_ps(t, _mm256_loadu_ps(weights + k));
+		}
+		acc = _mm256_add_ps(acc, t);
+	}
+
+	float half[4];
+	_mm_storeu_ps(half, _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+	float sum = (half[0] + half[1]) + (half[2] + half[3]);
+
+	// the rest of the program is not VEX encoded, so clear upper halves to avoid AVX-SSE transition penalties
+	_mm256_zeroupper();
+
+	return add_terms(sum, conc, diff, ids, weights, k, n, curr_conc, curr_diff);
+}
+
+#endif // DIFFUSION_X86
+
+/*-------------------------------- LOCAL VARIABLES --------------------------------*/
+
+// chosen once for the process, however many contexts are initialized and on whichever threads
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static DiffusionKernel kernel = sum_scalar;
+static const char *kernel_name = "scalar";
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+static void select_kernel()
+{
+#ifdef DIFFUSION_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernel = sum_avx2;
+		kernel_name = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2")) {
+		kernel = sum_sse;
+		kernel_name = "sse2";
+	}
+#endif // DIFFUSION_X86
+}
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+const char *diffusion_init()
+{
+	pthread_once(&kernel_once, select_kernel);
+	return kernel_name;
+}
+
+float diffusion_sum(const float *conc, const float *diff, const CellId *ids, const float *weights, int n, float curr_conc, float curr_diff)
+{
+	// CellId wraps a single int, so an array of ids has the same layout as an array of ints
+	return kernel(conc, diff, (const int*) ids, weights, n, curr_conc, curr_diff);
+}
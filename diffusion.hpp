@@ -0,0 +1,18 @@
+#ifndef DIFFUSION_HPP
+#define DIFFUSION_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "types.hpp"
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+// select the fastest implementation supported by the running CPU, once for the process, and return its name; all of
+// them give the same results
+const char *diffusion_init();
+
+// sum of min(diff[id], curr_diff) * (conc[id] - curr_conc) * weights[k] over the 'n' neighbors id = ids[k] of a cell,
+// for one chemical; 'weights' is NULL for isotropic diffusion
+float diffusion_sum(const float *conc, const float *diff, const CellId *ids, const float *weights, int n, float curr_conc, float curr_diff);
+
+#endif // DIFFUSION_HPP
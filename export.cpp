@@ -2,149 +2,606 @@
 
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #include <CGAL/Delaunay_triangulation_2.h>
-#include <CGAL/Interpolation_traits_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
 #include <CGAL/natural_neighbor_coordinates_2.h>
-#include <CGAL/interpolation_functions.h>
+#include <CGAL/function_objects.h>
 
 #include <png.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <string>
 
 #include "colormap.hpp"
 #include "simulation.hpp"
 #include "types.hpp"
+#include "workers.hpp"
 
 #include "export.hpp"
 
+/*-------------------------------- MACRO DEFINITIONS --------------------------------*/
+
+#define STRIP_ROWS 64 // rows of a texture held in memory at a time, so that its size is only limited by the disk
+#define TILE_SIZE  64 // width of the tiles that threads take from a strip for natural-neighbor interpolation
+
+// textures are handed over whole to background encoders only up to this size, for all chemicals of an export; larger
+// ones are streamed by strips as without encoders, so that each queued job stays small
+#define ASYNC_TEXTURE_BYTES (64 << 20)
+
+// moving a vertex costs several times as much as inserting it in bulk, so the triangulation is built again when more
+// than this fraction of the cells moved or were born since the last export
+#define REBUILD_FRACTION 0.25
+
 /*-------------------------------- TYPE DEFINITIONS --------------------------------*/
 
 typedef CGAL::Exact_predicates_inexact_constructions_kernel           K;
-typedef CGAL::Delaunay_triangulation_2<K>                             Delaunay_triangulation;
-typedef CGAL::Interpolation_traits_2<K>                               Traits;
 typedef K::FT                                                         Coord_type;
 typedef K::Point_2                                                    Point;
-typedef CGAL::Data_access<std::map<Point, Coord_type, K::Less_xy_2> > Value_access;
+
+// triangulation with the id of each cell stored in its vertex, so values of any chemical can be read from the cells
+typedef CGAL::Triangulation_vertex_base_with_info_2<int, K>           Vertex_base;
+typedef CGAL::Triangulation_data_structure_2<Vertex_base>             Data_structure;
+typedef CGAL::Delaunay_triangulation_2<K, Data_structure>             Valued_triangulation;
+typedef Valued_triangulation::Vertex_handle                           Vertex_handle;
+typedef Valued_triangulation::Face_handle                             Face_handle;
+
+struct TextureTriangulation::Data {
+	Valued_triangulation triangulation;
+	std::vector<Vertex_handle> vertices; // of each cell
+	std::vector<float> x, y;             // position of each cell in the triangulation
+	bool updatable;                      // false when some cells share a vertex, as they cannot be moved apart
+};
+
+// triangle of the tissue in pixel coordinates, with the cells at its vertices
+struct RasterTriangle {
+	float x[3], y[3];
+	int   id[3];
+};
+
+// one texture being made, of the concentration of a chemical
+struct TextureChannel {
+	const float   *values; // of each cell
+	float          value_min, value_max;
+	unsigned char *strip;
+};
+
+// strip of rows [row_begin, row_end) of one or more textures, filled by the threads of a pool; interpolation weights
+// are computed once for each pixel and applied to every channel
+struct TextureTask {
+	std::vector<TextureChannel> channels;
+	int   row_begin, row_end;
+	int   width;
+
+	// linear interpolation: triangles that cover some row of the strip
+	const std::vector<RasterTriangle> *triangles;
+
+	// natural-neighbor interpolation: pixel (c, r) is at (xmin + c * xstep, ymin + r * ystep)
+	const Valued_triangulation *triangulation;
+	float xmin, ymin, xstep, ystep;
+};
+
+// image waiting to be encoded by a background thread
+struct PngJob {
+	std::string filename;
+	int width, height;
+	std::vector<unsigned char> pixels;
+};
+
+// PNG file written one row at a time, from the top
+struct PngFile {
+	FILE       *file;
+	png_structp png;
+	png_infop   info;
+};
 
 /*-------------------------------- LOCAL VARIABLES --------------------------------*/
 
 static int tex_counter = 0;
+static TextureTriangulation default_triangulation; // of the default context, kept between exports
 //static int vec_counter = 0;
 
-static png_byte **rows = NULL;
+static int compression_level = Z_DEFAULT_COMPRESSION;
 
-static unsigned char *image = NULL;
+// background encoding of PNG files, see export_start_encoders
+static std::vector<pthread_t> encoders;
+static std::deque<PngJob*>    png_jobs;
+static int             max_pending_jobs = 0;
+static int             busy_encoders = 0;
+static bool            encoders_quit = false;
+static pthread_mutex_t png_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  job_cond  = PTHREAD_COND_INITIALIZER; // a job was queued, or encoders must quit
+static pthread_cond_t  room_cond = PTHREAD_COND_INITIALIZER; // a job was taken from the queue
+static pthread_cond_t  idle_cond = PTHREAD_COND_INITIALIZER; // a job was written
 
 //static std::ofstream svg;
 
+/*-------------------------------- PNG FUNCTIONS --------------------------------*/
+
+static void png_failed(UNUSED png_structp png, UNUSED png_const_charp message)
+{
+	fprintf(stderr, "png writing failed!\n");
+	abort();
+}
+
+static void png_begin(PngFile& png_file, const char *filename, int width, int height)
+{
+	// errors abort the program, so libpng never needs to jump back here
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_failed, NULL);
+	if (!png) {
+		png_failed(NULL, NULL);
+	}
+	png_infop info = png_create_info_struct(png);
+	if (!info) {
+		png_failed(NULL, NULL);
+	}
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		png_failed(NULL, NULL);
+	}
+
+	png_init_io(png, f);
+	png_set_IHDR(
+		png,
+		info,
+		width,
+		height,
+		8,
+		PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT
+	);
+	png_set_compression_level(png, compression_level);
+	png_write_info(png, info);
+
+	png_file.file = f;
+	png_file.png = png;
+	png_file.info = info;
+}
+
+static void png_end(PngFile& png_file)
+{
+	png_write_end(png_file.png, NULL);
+	png_destroy_write_struct(&png_file.png, &png_file.info);
+	fclose(png_file.file);
+}
+
+static void *encoder_main(void *)
+{
+	pthread_mutex_lock(&png_mutex);
+	while (true) {
+		while (png_jobs.empty() && !encoders_quit) {
+			pthread_cond_wait(&job_cond, &png_mutex);
+		}
+		if (png_jobs.empty()) {
+			break;
+		}
+		PngJob *job = png_jobs.front();
+		png_jobs.pop_front();
+		busy_encoders++;
+		pthread_cond_signal(&room_cond);
+		pthread_mutex_unlock(&png_mutex);
+
+		export_png(job->filename.c_str(), job->width, job->height, &job->pixels[0]);
+		delete job;
+
+		pthread_mutex_lock(&png_mutex);
+		busy_encoders--;
+		pthread_cond_broadcast(&idle_cond);
+	}
+	pthread_mutex_unlock(&png_mutex);
+	return NULL;
+}
+
+/*-------------------------------- TEXTURE TRIANGULATION METHODS --------------------------------*/
+
+TextureTriangulation::TextureTriangulation()
+{
+	data = new Data();
+	data->updatable = false;
+}
+
+TextureTriangulation::~TextureTriangulation()
+{
+	delete data;
+}
+
+void TextureTriangulation::update(const Simulation& simulation)
+{
+	Valued_triangulation& T = data->triangulation;
+	const CellArray& cells = simulation.curr_cells;
+	int n_cells = simulation.n_cells;
+	int n_known = (int) data->vertices.size();
+
+	// cells are never removed, but they are renumbered when reordered, in which case nearly all of them seem to move
+	std::vector<int> moved;
+	bool rebuild = !data->updatable || n_cells < n_known;
+	for (int id = 0; id < n_known && !rebuild; id++) {
+		if (cells.x[id] != data->x[id] || cells.y[id] != data->y[id]) {
+			moved.push_back(id);
+		}
+	}
+	rebuild = rebuild || moved.size() + (n_cells - n_known) > REBUILD_FRACTION * n_cells;
+
+	if (!rebuild) {
+		for (int i = 0; i < (int) moved.size() && data->updatable; i++) {
+			int id = moved[i];
+			Point p(cells.x[id], cells.y[id]);
+			data->updatable = (T.move_if_no_collision(data->vertices[id], p) == data->vertices[id]);
+		}
+		for (int id = n_known; id < n_cells && data->updatable; id++) {
+			// new cells are born next to the previous ones, which is where locating them starts
+			Point p(cells.x[id], cells.y[id]);
+			int n_vertices = T.number_of_vertices();
+			Vertex_handle v = (id > 0) ? T.insert(p, data->vertices[id - 1]->face()) : T.insert(p);
+			data->updatable = ((int) T.number_of_vertices() > n_vertices);
+			v->info() = id;
+			data->vertices.push_back(v);
+		}
+		rebuild = !data->updatable;
+	}
+
+	if (rebuild) {
+		// inserting all points at once lets CGAL sort them spatially first
+		std::vector<std::pair<Point, int> > points;
+		points.reserve(n_cells);
+		for (int id = 0; id < n_cells; id++) {
+			points.push_back(std::make_pair(Point(cells.x[id], cells.y[id]), id));
+		}
+		T.clear();
+		T.insert(points.begin(), points.end());
+
+		data->vertices.assign(n_cells, Vertex_handle());
+		for (Valued_triangulation::Finite_vertices_iterator v = T.finite_vertices_begin(); v != T.finite_vertices_end(); ++v) {
+			data->vertices[v->info()] = v;
+		}
+		data->updatable = ((int) T.number_of_vertices() == n_cells);
+	}
+
+	data->x.assign(cells.x, cells.x + n_cells);
+	data->y.assign(cells.y, cells.y + n_cells);
+}
+
 /*-------------------------------- INTERPOLATION FUNCTIONS --------------------------------*/
 
 // adapted from http://stackoverflow.com/questions/3191978/how-to-use-glut-opengl-to-render-to-a-file
 
 void export_png(const char *filename, int width, int height, unsigned char *pixels)
 {
-    rows = (png_byte **) realloc(rows, height * sizeof(png_byte *));
-    for (int i = 0; i < height; i++) {
-        rows[height - i - 1] = &pixels[i * width * 3];
-    }
-
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png) {
-    	fprintf(stderr, "png writing failed!\n");
-    	abort();
-    }
-    png_infop info = png_create_info_struct(png);
-    if (!info) {
-    	fprintf(stderr, "png writing failed!\n");
-    	abort();
-    }
-    if (setjmp(png_jmpbuf(png))) {
-    	fprintf(stderr, "png writing failed!\n");
-    	abort();
-    }
-
-    FILE *f = fopen(filename, "wb");
-    png_init_io(png, f);
-    png_set_IHDR(
-        png,
-        info,
-        width,
-        height,
-        8,
-        PNG_COLOR_TYPE_RGB,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_DEFAULT,
-        PNG_FILTER_TYPE_DEFAULT
-    );
-    png_write_info(png, info);
-    png_write_image(png, rows);
-    png_write_end(png, NULL);
-    png_destroy_write_struct(&png, &info);
-    fclose(f);
+	// the first row of 'pixels' is the bottom of the image
+	PngFile png_file;
+	png_begin(png_file, filename, width, height);
+	for (int i = height - 1; i >= 0; i--) {
+		png_write_row(png_file.png, &pixels[i * width * 3]);
+	}
+	png_end(png_file);
 }
 
-void export_texture(int chemical, int width, int height)
+void export_set_compression(int level)
 {
-	Delaunay_triangulation T;
-	std::map<Point, Coord_type, K::Less_xy_2> function_values;
+	compression_level = level;
+}
+
+void export_start_encoders(int n_threads, int max_pending)
+{
+	export_stop_encoders();
+	max_pending_jobs = std::max(1, max_pending);
+	encoders_quit = false;
+	encoders.resize(n_threads);
+	for (int t = 0; t < n_threads; t++) {
+		if (pthread_create(&encoders[t], NULL, encoder_main, NULL) != 0) {
+			std::cerr << "error: could not create encoder thread\n";
+			exit(1);
+		}
+	}
+}
+
+void export_png_async(const char *filename, int width, int height, std::vector<unsigned char>& pixels)
+{
+	if (encoders.empty()) {
+		export_png(filename, width, height, &pixels[0]);
+		return;
+	}
+
+	PngJob *job = new PngJob();
+	job->filename = filename;
+	job->width = width;
+	job->height = height;
+	job->pixels.swap(pixels);
+
+	pthread_mutex_lock(&png_mutex);
+	while ((int) png_jobs.size() >= max_pending_jobs) {
+		pthread_cond_wait(&room_cond, &png_mutex);
+	}
+	png_jobs.push_back(job);
+	pthread_cond_signal(&job_cond);
+	pthread_mutex_unlock(&png_mutex);
+}
+
+void export_flush()
+{
+	pthread_mutex_lock(&png_mutex);
+	while (!png_jobs.empty() || busy_encoders > 0) {
+		pthread_cond_wait(&idle_cond, &png_mutex);
+	}
+	pthread_mutex_unlock(&png_mutex);
+}
+
+void export_stop_encoders()
+{
+	// queued jobs are written before the encoders quit
+	pthread_mutex_lock(&png_mutex);
+	encoders_quit = true;
+	pthread_cond_broadcast(&job_cond);
+	pthread_mutex_unlock(&png_mutex);
+	for (int t = 0; t < (int) encoders.size(); t++) {
+		pthread_join(encoders[t], NULL);
+	}
+	encoders.clear();
+}
+
+void export_texture(int chemical, int width, int height, TextureQuality quality)
+{
+	char filename[256];
+	sprintf(filename, "tex-%02d.png", tex_counter);
+	export_texture(default_context, filename, chemical, width, height, quality, &default_triangulation);
+	tex_counter++;
+}
+
+void export_textures(int width, int height, TextureQuality quality)
+{
+	char prefix[256];
+	sprintf(prefix, "tex-%02d", tex_counter);
+	export_textures(default_context, prefix, width, height, quality, &default_triangulation);
+	tex_counter++;
+}
+
+static void set_color(const TextureChannel& channel, int index, float val)
+{
+	// lookup colormap and convert to RGB
+	float *color = colormap_lookup(val, channel.value_min, channel.value_max);
+	unsigned char *pixel = &channel.strip[index * 3];
+	pixel[0] = (int) (color[0] * 255);
+	pixel[1] = (int) (color[1] * 255);
+	pixel[2] = (int) (color[2] * 255);
+}
+
+// interpolates linearly over the part of 'triangle' that lies in rows [row_begin, row_end) of the strip
+
+static void raster_triangle(const RasterTriangle& t, int row_begin, int row_end, const TextureTask& task)
+{
+	double area = (double) (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (double) (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+	if (fabs(area) < 1e-12) {
+		return;
+	}
+
+	// pixels on an edge shared by two triangles get nearly the same value from both, so edges are inclusive, with a
+	// small tolerance for the rounding of pixel coordinates, so that no pixel inside the hull is missed
+	const float  margin = 0.01f;
+	const double eps = 1e-3;
+
+	int r_min = std::max(row_begin, (int) ceilf(std::min(t.y[0], std::min(t.y[1], t.y[2])) - margin));
+	int r_max = std::min(row_end - 1, (int) floorf(std::max(t.y[0], std::max(t.y[1], t.y[2])) + margin));
+	int c_min = std::max(0, (int) ceilf(std::min(t.x[0], std::min(t.x[1], t.x[2])) - margin));
+	int c_max = std::min(task.width - 1, (int) floorf(std::max(t.x[0], std::max(t.x[1], t.x[2])) + margin));
+
+	for (int r = r_min; r <= r_max; r++) {
+		for (int c = c_min; c <= c_max; c++) {
+			double w0 = ((t.x[1] - c) * (t.y[2] - r) - (t.x[2] - c) * (t.y[1] - r)) / area;
+			double w1 = ((t.x[2] - c) * (t.y[0] - r) - (t.x[0] - c) * (t.y[2] - r)) / area;
+			double w2 = 1 - w0 - w1;
+			if (w0 < -eps || w1 < -eps || w2 < -eps) {
+				continue;
+			}
+			int index = (r - task.row_begin) * task.width + c;
+			for (int k = 0; k < (int) task.channels.size(); k++) {
+				const float *values = task.channels[k].values;
+				set_color(task.channels[k], index, w0 * values[t.id[0]] + w1 * values[t.id[1]] + w2 * values[t.id[2]]);
+			}
+		}
+	}
+}
+
+// each thread takes a band of rows of the strip
+
+static void raster_rows(int thread, int n_threads, void *data)
+{
+	const TextureTask& task = *(const TextureTask*) data;
+	int row_begin, row_end;
+	WorkerPool::split(task.row_end - task.row_begin, thread, n_threads, row_begin, row_end);
+
+	const std::vector<RasterTriangle>& triangles = *task.triangles;
+	for (int i = 0; i < (int) triangles.size(); i++) {
+		raster_triangle(triangles[i], task.row_begin + row_begin, task.row_begin + row_end, task);
+	}
+}
+
+// each thread takes a range of tiles of the strip; queries only read the triangulation, so threads share it, and each
+// one starts locating a pixel from the face of the previous one, which is usually the same or next to it
+
+static void interpolate_tiles(int thread, int n_threads, void *data)
+{
+	const TextureTask& task = *(const TextureTask*) data;
+	const Valued_triangulation& T = *task.triangulation;
+	int tile_begin, tile_end;
+	WorkerPool::split((task.width + TILE_SIZE - 1) / TILE_SIZE, thread, n_threads, tile_begin, tile_end);
+
+	std::vector<std::pair<Vertex_handle, Coord_type> > coords;
+	Face_handle face = Face_handle();
+	for (int tile = tile_begin; tile < tile_end; tile++) {
+		int c_end = std::min(task.width, (tile + 1) * TILE_SIZE);
+		for (int r = task.row_begin; r < task.row_end; r++) {
+			for (int c = tile * TILE_SIZE; c < c_end; c++) {
+				// query point
+				Point q(task.xmin + c * task.xstep, task.ymin + r * task.ystep);
+				face = T.locate(q, face);
+
+				// get natural coordinates for query point
+				coords.clear();
+				Coord_type norm = CGAL::natural_neighbor_coordinates_2(T, q, std::back_inserter(coords),
+						CGAL::Identity<std::pair<Vertex_handle, Coord_type> >(), face).second;
+
+				if (coords.size()) {
+					// query point is inside the convex hull: calculate interpolated value from the cells at the vertices
+					int index = (r - task.row_begin) * task.width + c;
+					for (int k = 0; k < (int) task.channels.size(); k++) {
+						const float *values = task.channels[k].values;
+						Coord_type val = 0;
+						for (int i = 0; i < (int) coords.size(); i++) {
+							val += coords[i].second * values[coords[i].first->info()];
+						}
+						set_color(task.channels[k], index, val / norm);
+					}
+				}
+				// query point is outside: keep background color
+			}
+		}
+	}
+}
 
-    for (int i = 0; i < simulation.n_cells; i++) {
-		Cell& curr_cell = simulation.curr_cells[i];
-		float x = curr_cell.x;
-		float y = curr_cell.y;
-		float v = curr_cell.conc[chemical];
+// writes a texture of each of 'chemicals' to the matching file, or to 'frame' (one chemical) when given
+static void export_chemicals(const SimulationContext& context, const std::vector<int>& chemicals, const std::vector<std::string>& filenames, int width, int height, TextureQuality quality, TextureTriangulation *triangulation, std::vector<unsigned char> *frame = NULL)
+{
+	const Simulation& simulation = context.simulation;
+	const Statistics& statistics = context.statistics;
 
-		// add point to Delaunay triangulation and store associated value
-		K::Point_2 p(x, y);
-		T.insert(p);
-		function_values.insert(std::make_pair(p, v));
+	TextureTriangulation local_triangulation;
+	if (!triangulation) {
+		triangulation = &local_triangulation;
 	}
+	triangulation->update(simulation);
+	const Valued_triangulation& T = triangulation->get_data().triangulation;
 
     //std::cout << "v min=" << statistics.chem_min[0] << " v max=" << statistics.chem_max[0] << '\n';
     //std::cout << "x min=" << statistics.cell_xmin   << " x max=" << statistics.cell_xmax << '\n';
     //std::cout << "y min=" << statistics.cell_ymin   << " y max=" << statistics.cell_ymax << '\n';
 
-    float xrange = statistics.cell_xmax - statistics.cell_xmin;
-    float yrange = statistics.cell_ymax - statistics.cell_ymin;
-    float xmin = statistics.cell_xmin; // + (statistics.cell_xmax - statistics.cell_xmin - range) / 2;
-    float ymin = statistics.cell_ymin; // + (statistics.cell_ymax - statistics.cell_ymin - range) / 2;
-    colormap_set_limits(statistics.chem_min[chemical], statistics.chem_max[chemical]);
+	float xrange = statistics.cell_xmax - statistics.cell_xmin;
+	float yrange = statistics.cell_ymax - statistics.cell_ymin;
 
-    image = (unsigned char *) realloc(image, width * height * 3 * sizeof(unsigned char));
+	int n_channels = (int) chemicals.size();
+	std::vector<unsigned char> strips(n_channels * width * STRIP_ROWS * 3);
+	std::vector<PngFile> png_files(n_channels);
 
-	for (int r = 0; r < height; r++) {
-		for (int c = 0; c < width; c++) {
-			int index = (r * width + c) * 3;
-			float x = xmin + xrange * c / (width - 1);
-			float y = ymin + yrange * r / (height - 1);
-
-			// query point
-			K::Point_2 q(x, y);
-
-			// get natural coordinates for query point
-			std::vector<std::pair<Point, Coord_type> > coords;
-			Coord_type norm = CGAL::natural_neighbor_coordinates_2(T, q, std::back_inserter(coords)).second;
+	// with background encoders, whole images are made and handed over to them instead of streaming the strips, unless
+	// they are too large to be held in memory
+	bool async = !encoders.empty() && (size_t) n_channels * width * height * 3 <= ASYNC_TEXTURE_BYTES;
+	bool whole = async || frame;
+	std::vector<std::vector<unsigned char> > images(whole ? n_channels : 0);
+	for (int k = 0; k < (int) images.size(); k++) {
+		images[k].resize(width * height * 3);
+	}
 
-			if (coords.size()) {
-				// query point is inside the convex hull: calculate interpolated value
-				Coord_type val = CGAL::linear_interpolation(coords.begin(), coords.end(), norm, Value_access(function_values));
+	TextureTask task;
+	task.channels.resize(n_channels);
+	for (int k = 0; k < n_channels; k++) {
+		TextureChannel& channel = task.channels[k];
+		channel.values = simulation.curr_cells.conc[chemicals[k]];
+		channel.value_min = statistics.chem_min[chemicals[k]];
+		channel.value_max = statistics.chem_max[chemicals[k]];
+		channel.strip = &strips[k * width * STRIP_ROWS * 3];
+	}
+	task.width = width;
+	task.triangulation = &T;
+	task.xmin = statistics.cell_xmin;
+	task.ymin = statistics.cell_ymin;
+	task.xstep = xrange / (width - 1);
+	task.ystep = yrange / (height - 1);
+
+	// for linear interpolation, triangles are walked once and sorted into the strips they cover
+	int n_strips = (height + STRIP_ROWS - 1) / STRIP_ROWS;
+	std::vector<std::vector<RasterTriangle> > strip_triangles;
+	if (quality == TEXTURE_LINEAR) {
+		float xscale = (xrange > 0) ? (width - 1) / xrange : 0;
+		float yscale = (yrange > 0) ? (height - 1) / yrange : 0;
+		strip_triangles.resize(n_strips);
+		for (Valued_triangulation::Finite_faces_iterator f = T.finite_faces_begin(); f != T.finite_faces_end(); ++f) {
+			RasterTriangle t;
+			for (int k = 0; k < 3; k++) {
+				const Point& p = f->vertex(k)->point();
+				t.x[k] = (p.x() - statistics.cell_xmin) * xscale;
+				t.y[k] = (p.y() - statistics.cell_ymin) * yscale;
+				t.id[k] = f->vertex(k)->info();
+			}
+			int s_begin = std::max(0, (int) floorf(std::min(t.y[0], std::min(t.y[1], t.y[2]))) / STRIP_ROWS);
+			int s_end = std::min(n_strips - 1, (int) ceilf(std::max(t.y[0], std::max(t.y[1], t.y[2]))) / STRIP_ROWS);
+			for (int s = s_begin; s <= s_end; s++) {
+				strip_triangles[s].push_back(t);
+			}
+		}
+	}
 
-				// lookup colormap and convert to RGB
-				float *color = colormap_lookup(val);
-				image[index + 0] = (int) (color[0] * 255);
-				image[index + 1] = (int) (color[1] * 255);
-				image[index + 2] = (int) (color[2] * 255);
+	// strips are made from the top of the images, on the threads of the simulation when it has any
+	for (int k = 0; k < n_channels && !whole; k++) {
+		png_begin(png_files[k], filenames[k].c_str(), width, height);
+	}
+	for (int s = n_strips - 1; s >= 0; s--) {
+		task.row_begin = s * STRIP_ROWS;
+		task.row_end = std::min(height, task.row_begin + STRIP_ROWS);
+		task.triangles = (quality == TEXTURE_LINEAR) ? &strip_triangles[s] : NULL;
+
+		// background is black
+		if (whole) {
+			for (int k = 0; k < n_channels; k++) {
+				task.channels[k].strip = &images[k][task.row_begin * width * 3];
 			}
-			else {
-				// query point is outside: use background color
-				image[index + 0] = 0;
-				image[index + 1] = 0;
-				image[index + 2] = 0;
+		}
+		else {
+			std::fill(strips.begin(), strips.end(), 0);
+		}
+		WorkerTask work = (quality == TEXTURE_LINEAR) ? raster_rows : interpolate_tiles;
+		if (context.workers) {
+			context.workers->run(work, &task);
+		}
+		else {
+			work(0, 1, &task);
+		}
+
+		for (int k = 0; k < n_channels && !whole; k++) {
+			for (int r = task.row_end - 1; r >= task.row_begin; r--) {
+				png_write_row(png_files[k].png, &task.channels[k].strip[(r - task.row_begin) * width * 3]);
 			}
 		}
 	}
+	for (int k = 0; k < n_channels; k++) {
+		if (frame) {
+			frame->swap(images[k]);
+		}
+		else if (async) {
+			export_png_async(filenames[k].c_str(), width, height, images[k]);
+		}
+		else {
+			png_end(png_files[k]);
+		}
+	}
+}
 
-	char filename[256];
-	sprintf(filename, "tex-%02d.png", tex_counter);
-	export_png(filename, width, height, image);
-	tex_counter++;
+void export_texture(const SimulationContext& context, const char *filename, int chemical, int width, int height, TextureQuality quality, TextureTriangulation *triangulation)
+{
+	export_chemicals(context, std::vector<int>(1, chemical), std::vector<std::string>(1, filename), width, height, quality, triangulation);
+}
+
+void export_textures(const SimulationContext& context, const char *prefix, int width, int height, TextureQuality quality, TextureTriangulation *triangulation)
+{
+	const Simulation& simulation = context.simulation;
+
+	std::vector<int> chemicals;
+	std::vector<std::string> filenames;
+	for (int ch = 0; ch < simulation.n_chemicals; ch++) {
+		chemicals.push_back(ch);
+		filenames.push_back(std::string(prefix) + "-" + simulation.chemicals[ch].name + ".png");
+	}
+	export_chemicals(context, chemicals, filenames, width, height, quality, triangulation);
+}
+
+bool export_frame(const SimulationContext& context, VideoWriter& video, int chemical, TextureQuality quality, TextureTriangulation *triangulation)
+{
+	std::vector<unsigned char> pixels;
+	export_chemicals(context, std::vector<int>(1, chemical), std::vector<std::string>(), video.get_width(), video.get_height(), quality, triangulation, &pixels);
+	return video.write(&pixels[0]);
 }
 
 /*void export_texture_wrap(int chemical, int width, int height, int nns_dim_x, int nns_dim_y)
@@ -156,10 +613,9 @@ void export_texture(int chemical, int width, int height)
 		int j = (r + nns_dim_y) % nns_dim_y;
 		for (int c = -1; c <= nns_dim_x; c++) {
 			int i = (c + nns_dim_x) % nns_dim_x;
-			Cell& curr_cell = simulation.curr_cells[i + j * nns_dim_x];
-			float x = curr_cell.x;
-			float y = curr_cell.y;
-			float v = curr_cell.conc[chemical];
+			float x = simulation.curr_cells.x[i + j * nns_dim_x];
+			float y = simulation.curr_cells.y[i + j * nns_dim_x];
+			float v = simulation.curr_cells.conc[chemical][i + j * nns_dim_x];
 			if (c == -1) { x -= 2 * nns_dim_x; } else if (c == nns_dim_x) { x += 2 * nns_dim_x; }
 			if (r == -1) { y -= 2 * nns_dim_x; } else if (r == nns_dim_y) { y += 2 * nns_dim_x; }
 
@@ -1,11 +1,75 @@
 #ifndef EXPORT_HPP
 #define EXPORT_HPP
 
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "simulation.hpp"
+#include "video.hpp"
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+// interpolation between cells: linear over the Delaunay triangles, or natural-neighbor, smoother but much slower
+enum TextureQuality {TEXTURE_LINEAR, TEXTURE_NATURAL};
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// triangulation of the cells of a simulation, kept from one export to the next so that only the cells that moved or
+// were born since are updated, as when exporting a series of textures of a growing tissue
+class TextureTriangulation {
+public:
+	struct Data; // defined in export.cpp, with the CGAL types
+
+private:
+	Data *data;
+
+	TextureTriangulation(const TextureTriangulation&);
+	TextureTriangulation& operator=(const TextureTriangulation&);
+
+public:
+	TextureTriangulation();
+	~TextureTriangulation();
+
+	void update(const Simulation& simulation);
+	Data& get_data() { return *data; }
+};
+
 /*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
 
 void export_png(const char *filename, int width, int height, unsigned char *pixels);
 
-void export_texture(int chemical = 0, int width = 256, int height = 256);
+// zlib level of the PNG files, from 0 (fastest) to 9 (smallest)
+void export_set_compression(int level);
+
+// starts 'n_threads' background threads that encode and write the PNG files; callers are blocked while 'max_pending'
+// images wait for them, so memory stays bounded when images are made faster than they can be written
+void export_start_encoders(int n_threads, int max_pending = 4);
+
+// takes over 'pixels' (left empty) and writes it as above on a background thread, or right away if none is started;
+// textures are also handed over to the background threads while they run, unless their images take more than 64 MB,
+// which are streamed to the file row by row as without them
+void export_png_async(const char *filename, int width, int height, std::vector<unsigned char>& pixels);
+
+// waits until all the images handed over are written
+void export_flush();
+
+// writes the images still waiting and stops the background threads; call it before simulation_done
+void export_stop_encoders();
+
+// writes tex-NN.png from the default context, numbered in call order; its triangulation is kept between calls
+void export_texture(int chemical = 0, int width = 256, int height = 256, TextureQuality quality = TEXTURE_LINEAR);
+
+// writes tex-NN-NAME.png for every chemical NAME of the default context, numbered like the above
+void export_textures(int width = 256, int height = 256, TextureQuality quality = TEXTURE_LINEAR);
+
+// writes 'filename' from 'context'; unlike the above, it can be called from several threads at once; 'triangulation',
+// if given, is updated and kept for the next export of the same context
+void export_texture(const SimulationContext& context, const char *filename, int chemical = 0, int width = 256, int height = 256, TextureQuality quality = TEXTURE_LINEAR, TextureTriangulation *triangulation = NULL);
+
+// writes PREFIX-NAME.png for every chemical NAME of 'context', interpolating once for all of them
+void export_textures(const SimulationContext& context, const char *prefix, int width = 256, int height = 256, TextureQuality quality = TEXTURE_LINEAR, TextureTriangulation *triangulation = NULL);
+
+// appends a texture of 'chemical' to 'video', at its size; false if it could not be written
+bool export_frame(const SimulationContext& context, VideoWriter& video, int chemical = 0, TextureQuality quality = TEXTURE_LINEAR, TextureTriangulation *triangulation = NULL);
 
 //void export_texture_wrap(int chemical, int width, int height, int nns_dim_x, int nns_dim_y);
 
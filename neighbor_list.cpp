@@ -0,0 +1,217 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cmath>
+
+#include "neighbor_list.hpp"
+
+/*-------------------------------- CONSTRUCTOR --------------------------------*/
+
+NeighborList::NeighborList(int n_threads, float skin)
+{
+	this->skin = skin;
+	built = false;
+	n_builds = n_pending = n_inserted = 0;
+	recorded.resize(n_threads < 1 ? 1 : n_threads);
+}
+
+/*-------------------------------- VALIDATION --------------------------------*/
+
+bool NeighborList::validate(const CellArray& cells, int n_cells)
+{
+	if (!built) {
+		return false;
+	}
+	if (n_cells != (int) ref_x.size()) {
+		built = false;
+		n_pending = 0;
+		return false;
+	}
+
+	// two cells can only have become neighbors without being candidates of each other when their displacements,
+	// slack included, add up to more than the skin; exact lists do not allow any displacement
+	bool moved = false;
+	float first = 0, second = 0;
+	for (int id = 0; id < n_cells && !moved; id++) {
+		float ddx = cells.x[id] - ref_x[id];
+		float ddy = cells.y[id] - ref_y[id];
+		if (skin == 0) {
+			moved = (ddx != 0 || ddy != 0);
+			continue;
+		}
+		float d = sqrtf(ddx * ddx + ddy * ddy) + slack[id];
+		if (d > first) {
+			second = first;
+			first = d;
+		}
+		else if (d > second) {
+			second = d;
+		}
+		moved = (first + second > skin);
+	}
+	if (moved) {
+		built = false;
+		n_pending = 0;
+		return false;
+	}
+	n_inserted += n_pending;
+	n_pending = 0;
+	return true;
+}
+
+/*-------------------------------- RECORDING --------------------------------*/
+
+void NeighborList::start_recording(int thread)
+{
+	Rows& rows = recorded[thread];
+	rows.cell_ids.clear();
+	rows.counts.clear();
+	rows.ids.clear();
+	rows.dx.clear();
+	rows.dy.clear();
+	rows.norm.clear();
+}
+
+void NeighborList::record(int thread, CellId id, int n, const CellId *ids, const float *dx, const float *dy, const float *norm)
+{
+	Rows& rows = recorded[thread];
+	rows.cell_ids.push_back(id);
+	rows.counts.push_back(n);
+	rows.ids.insert(rows.ids.end(), ids, ids + n);
+	if (has_geometry()) {
+		rows.dx.insert(rows.dx.end(), dx, dx + n);
+		rows.dy.insert(rows.dy.end(), dy, dy + n);
+		rows.norm.insert(rows.norm.end(), norm, norm + n);
+	}
+}
+
+/*-------------------------------- BUILD --------------------------------*/
+
+void NeighborList::build(const CellArray& cells, int n_cells)
+{
+	// row sizes, in cell id order
+	counts.assign(n_cells, 0);
+	for (int t = 0; t < (int) recorded.size(); t++) {
+		const Rows& rows = recorded[t];
+		for (int r = 0; r < (int) rows.cell_ids.size(); r++) {
+			counts[rows.cell_ids[r]] = rows.counts[r];
+		}
+	}
+
+	offsets.resize(n_cells + 1);
+	offsets[0] = 0;
+	for (int id = 0; id < n_cells; id++) {
+		offsets[id + 1] = offsets[id] + get_capacity(counts[id]);
+	}
+
+	int total = offsets[n_cells];
+	ids.resize(total);
+	if (has_geometry()) {
+		dx.resize(total);
+		dy.resize(total);
+		norm.resize(total);
+	}
+
+	// scatter rows to their place
+	for (int t = 0; t < (int) recorded.size(); t++) {
+		const Rows& rows = recorded[t];
+		int from = 0;
+		for (int r = 0; r < (int) rows.cell_ids.size(); r++) {
+			int to = offsets[rows.cell_ids[r]];
+			for (int k = 0; k < rows.counts[r]; k++) {
+				ids[to + k] = rows.ids[from + k];
+			}
+			if (has_geometry()) {
+				for (int k = 0; k < rows.counts[r]; k++) {
+					dx[to + k]   = rows.dx[from + k];
+					dy[to + k]   = rows.dy[from + k];
+					norm[to + k] = rows.norm[from + k];
+				}
+			}
+			from += rows.counts[r];
+		}
+	}
+
+	ref_x.assign(cells.x, cells.x + n_cells);
+	ref_y.assign(cells.y, cells.y + n_cells);
+	slack.assign(n_cells, 0);
+	built = true;
+	n_builds++;
+}
+
+/*-------------------------------- INCREMENTAL UPDATE --------------------------------*/
+
+void NeighborList::insert(CellId id, CellId parent_id, float x, float y)
+{
+	if (!built || has_geometry() || id != (int) ref_x.size() || counts[parent_id] >= MAX_NEIGHBORS) {
+		built = false;
+		return;
+	}
+
+	// the candidates of the parent were gathered around where its row was, so the child starts that far from it; past
+	// the skin, the lists would not pass the next validation anyway
+	float ddx = x - ref_x[parent_id];
+	float ddy = y - ref_y[parent_id];
+	float child_slack = sqrtf(ddx * ddx + ddy * ddy) + slack[parent_id];
+	if (child_slack > skin) {
+		built = false;
+		return;
+	}
+
+	// new row at the end, with the candidates of the parent and the parent itself
+	int count = counts[parent_id];
+	int offset = offsets[id];
+	ids.resize(offset + get_capacity(count + 1));
+	offsets.push_back((int) ids.size());
+	counts.push_back(0);
+
+	int parent_offset = offsets[parent_id];
+	for (int k = 0; k < count; k++) {
+		CellId neighbor_id = ids[parent_offset + k];
+		ids[offset + counts[id]++] = neighbor_id;
+		if (!append(neighbor_id, id)) {
+			return;
+		}
+	}
+	ids[offset + counts[id]++] = parent_id;
+	if (!append(parent_id, id)) {
+		return;
+	}
+
+	ref_x.push_back(x);
+	ref_y.push_back(y);
+	slack.push_back(child_slack);
+	n_pending++;
+}
+
+/*-------------------------------- MEMORY --------------------------------*/
+
+size_t NeighborList::get_used_memory() const
+{
+	if (!built) {
+		return 0;
+	}
+	return (offsets.size() + counts.size()) * sizeof(int) + ids.size() * sizeof(CellId)
+			+ (dx.size() + dy.size() + norm.size() + ref_x.size() + ref_y.size() + slack.size()) * sizeof(float);
+}
+
+/*-------------------------------- PRIVATE METHODS --------------------------------*/
+
+// rows of Verlet lists get some spare room, so that cells created by division can be added without a rebuild
+int NeighborList::get_capacity(int count) const
+{
+	if (has_geometry()) {
+		return count;
+	}
+	return count + count / 4 + 4;
+}
+
+// add 'neighbor_id' to the row of 'id', or invalidate the lists if the row is full
+bool NeighborList::append(CellId id, CellId neighbor_id)
+{
+	if (offsets[id] + counts[id] >= offsets[id + 1] || counts[id] >= MAX_NEIGHBORS) {
+		built = false;
+		return false;
+	}
+	ids[offsets[id] + counts[id]++] = neighbor_id;
+	return true;
+}
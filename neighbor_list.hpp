@@ -0,0 +1,88 @@
+#ifndef NEIGHBOR_LIST_HPP
+#define NEIGHBOR_LIST_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <vector>
+
+#include "types.hpp"
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// neighborhoods of all cells cached in compressed sparse row form, so that most steps can skip the NNS entirely;
+// the neighbors of cell 'id' are entries [offsets[id], offsets[id] + counts[id]) of 'ids', and each row may have
+// spare room up to offsets[id + 1]
+//
+// without skin the lists are exact and only valid while no cell moves, so they also keep 'dx', 'dy' and 'norm',
+// with wrapped neighbors already relocated; with skin they are Verlet lists of all candidates within
+// INFLUENCE_RANGE + skin, which stay valid while the two largest displacements add up to at most the skin
+//
+// a cell created by division takes the candidates of its parent, gathered around the parent's reference position,
+// which it is about 1 away from; that offset is kept as its 'slack' and counted in its displacement, so inserted cells
+// only keep the lists valid with a skin above 2, as both a child and a neighbor may carry such an offset
+
+class NeighborList {
+public:
+	std::vector<int>    offsets;
+	std::vector<int>    counts;
+	std::vector<CellId> ids;
+	std::vector<float>  dx, dy, norm;
+
+private:
+	// rows recorded by one thread while the lists are being rebuilt
+	struct Rows {
+		std::vector<CellId> cell_ids;
+		std::vector<int>    counts;
+		std::vector<CellId> ids;
+		std::vector<float>  dx, dy, norm;
+	};
+
+	bool  built;
+	float skin;
+
+	std::vector<float> ref_x, ref_y; // positions the lists were built from, or where inserted cells were created
+	std::vector<float> slack;        // distance from the reference position to where the row was gathered
+	std::vector<Rows>  recorded;     // one entry per thread
+
+	int n_builds;
+	int n_pending;  // cells inserted since the last validation
+	int n_inserted; // cells inserted that passed a validation, each saving a rebuild
+
+public:
+	NeighborList(int n_threads, float skin = 0);
+
+	bool is_built() const { return built; }
+	bool has_geometry() const { return skin == 0; }
+	float get_radius() const { return INFLUENCE_RANGE + skin; }
+
+	// compare current positions with those the lists were built from, and invalidate the lists when cells moved too
+	// far or cells were added or removed
+	bool validate(const CellArray& cells, int n_cells);
+
+	// drop the lists, e.g. after cells were renumbered
+	void invalidate() { built = false; }
+
+	// called by each thread for each processed cell while the lists are not built; 'dx', 'dy' and 'norm' are only
+	// used when the lists have geometry
+	void start_recording(int thread);
+	void record(int thread, CellId id, int n, const CellId *ids, const float *dx, const float *dy, const float *norm);
+
+	// assemble the rows recorded by all threads, for the positions they were computed from
+	void build(const CellArray& cells, int n_cells);
+
+	// add a cell created by division of 'parent_id' at 'x', 'y', with 'id' equal to the number of cells so far; the
+	// child starts with the candidates of its parent, so the lists stay valid without a rebuild when the skin allows
+	void insert(CellId id, CellId parent_id, float x, float y);
+
+	int get_build_count() const { return n_builds; }
+	int get_insert_count() const { return n_inserted; }
+
+	// bytes taken by the lists, including spare room in rows, but not by unused vector capacity
+	size_t get_used_memory() const;
+
+private:
+	int get_capacity(int count) const;
+	bool append(CellId id, CellId neighbor_id);
+};
+
+#endif // NEIGHBOR_LIST_HPP
@@ -39,7 +39,7 @@ public:
 
     virtual void add_position(float x, float y, CellId id) = 0;
     virtual void update_position(CellId id, float x, float y) = 0;
-    virtual void update_all_positions(Cell* cells) = 0;
+    virtual void update_all_positions(const CellArray& cells) = 0;
 
     virtual CellId locate_nearest(float x, float y) = 0;
 
@@ -53,8 +53,16 @@ public:
     virtual CellId *query_range(CellId id, float r) = 0;
     //virtual CellId *query_nearest(CellId id, int k) = 0;
 
-    // get used  memory
-    // get total memory
+    // positional access, safe to be called concurrently after setup() (results go to a caller-owned buffer of MAX_NEIGHBORS + 1 ids)
+    virtual int get_position_count() = 0;
+    virtual CellId get_cell_id(int index) = 0;
+    virtual CellId *query_position_range(int index, float r, CellId *result) = 0;
+
+    // give each position the id 'new_ids[id]', after cells were renumbered; setup() must be called again
+    virtual void remap_cell_ids(const std::vector<CellId>& new_ids) = 0;
+
+    // bytes taken by the positions and search structures of all cells added so far
+    virtual size_t get_used_memory() = 0;
 };
 
 /*-------------------------------- IMPLEMENTATIONS --------------------------------*/
@@ -62,13 +70,10 @@ public:
 class NNS_KD_Tree : public NNS {
 private:
 	int counter, curr_position;
-    Position *positions;
+    std::vector<Position> positions;
 
     void *kd_tree;
-    CellId neighbors[500]; // TODO: remove hard-coded limit
-
-	std::vector<std::pair<size_t,float> > ret_matches;
-	float query_pt[2];
+    CellId neighbors[MAX_NEIGHBORS + 1];
 
 public:
     NNS_KD_Tree();
@@ -76,7 +81,7 @@ public:
 
     void add_position(float x, float y, CellId id);
     void update_position(CellId id, float x, float y);
-    void update_all_positions(Cell* cells);
+    void update_all_positions(const CellArray& cells);
 
     CellId locate_nearest(float x, float y);
 
@@ -90,6 +95,13 @@ public:
     CellId *query_range(CellId id, float r);
     //CellId *query_nearest(CellId id, int k);
 
+    int get_position_count();
+    CellId get_cell_id(int index);
+    CellId *query_position_range(int index, float r, CellId *result);
+
+    void remap_cell_ids(const std::vector<CellId>& new_ids);
+    size_t get_used_memory();
+
     // -------- Methods for Nanoflann adaptor interface --------
 
     // Must return the number of data points
@@ -119,19 +131,63 @@ public:
     //   Look at bb.size() to find out the expected dimensionality (e.g. 2 or 3 for point clouds)
     template <class BBOX>
     bool kdtree_get_bbox(UNUSED BBOX &bb) const { return false; }
+};
+
+// exact search over a uniform grid of buckets, one influence range wide, rebuilt by a counting sort on each setup;
+// positions are kept in bucket order, so cells that are close in space are also close in memory
+
+class NNS_CellList : public NNS {
+private:
+	int counter, curr_position;
+    std::vector<Position> positions;
+    std::vector<Position> sorted;  // scratch for the counting sort
+    std::vector<int> bucket_of;    // bucket of each position, in the order before sorting
+    std::vector<int> bucket_start; // positions of bucket 'b' are [bucket_start[b], bucket_start[b + 1])
+
+    float min_x, min_y;
+    float bucket_size;
+    int dim_x, dim_y;
+    CellId neighbors[MAX_NEIGHBORS + 1];
+
+public:
+    NNS_CellList();
+    ~NNS_CellList();
+
+    void add_position(float x, float y, CellId id);
+    void update_position(CellId id, float x, float y);
+    void update_all_positions(const CellArray& cells);
+
+    CellId locate_nearest(float x, float y);
+
+    void setup();
+
+    void set_start_position();
+    bool has_next_position();
+    CellId get_current_cell_id();
+    CellId *query_current_range(float r);
+
+    CellId *query_range(CellId id, float r);
+    //CellId *query_nearest(CellId id, int k);
+
+    int get_position_count();
+    CellId get_cell_id(int index);
+    CellId *query_position_range(int index, float r, CellId *result);
+
+    void remap_cell_ids(const std::vector<CellId>& new_ids);
+    size_t get_used_memory();
 
 private:
-    CellId *query_position_range(int index, float r);
+    int get_bucket_x(float x) const;
+    int get_bucket_y(float y) const;
 };
 
 class NNS_SpatialSorting : public NNS {
 private:
 	int counter, curr_position;
-    Position *positions;
+    std::vector<Position> positions;
 
     int dim_x, dim_y;
 	int n_size;
-    int candidates[121];
     CellId neighbors[121];
     
     std::vector<bool> row_is_sorted;
@@ -143,7 +199,7 @@ public:
 
     void add_position(float x, float y, CellId id);
     void update_position(CellId id, float x, float y);
-    void update_all_positions(Cell* cells);
+    void update_all_positions(const CellArray& cells);
 
     CellId locate_nearest(float x, float y);
 
@@ -157,9 +213,15 @@ public:
     CellId *query_range(CellId id, float r);
     //CellId *query_nearest(CellId id, int k);
 
+    int get_position_count();
+    CellId get_cell_id(int index);
+    CellId *query_position_range(int index, float r, CellId *result);
+
+    void remap_cell_ids(const std::vector<CellId>& new_ids);
+    size_t get_used_memory();
+
 private:
-    CellId *query_position_range(int index, float r);
-    void get_hard_neighborhood(int index);
+    void get_hard_neighborhood(int index, int *candidates);
 
     void spatial_odd_even_sort();
 
@@ -188,7 +250,7 @@ private:
 class NNS_SquareGrid : public NNS {
 private:
 	int counter, curr_position;
-    Position *positions;
+    std::vector<Position> positions;
 
     int dim_x, dim_y;
     CellId neighbors[9];
@@ -200,7 +262,7 @@ public:
 
     void add_position(float x, float y, CellId id);
     void update_position(CellId id, float x, float y);
-    void update_all_positions(Cell* cells);
+    void update_all_positions(const CellArray& cells);
 
     CellId locate_nearest(float x, float y);
 
@@ -214,8 +276,14 @@ public:
     CellId *query_range(CellId id, float r);
     //CellId *query_nearest(CellId id, int k);
 
+    int get_position_count();
+    CellId get_cell_id(int index);
+    CellId *query_position_range(int index, float r, CellId *result);
+
+    void remap_cell_ids(const std::vector<CellId>& new_ids);
+    size_t get_used_memory();
+
 private:
-    CellId *query_position_range(int index, float r);
     void get_hard_neighborhood(int index);
 };
 
@@ -0,0 +1,222 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "nns_base.hpp"
+
+/*-------------------------------- CONSTRUCTOR AND DESTRUCTOR --------------------------------*/
+
+NNS_CellList::NNS_CellList()
+{
+	counter = 0;
+	curr_position = -1;
+
+	min_x = min_y = 0;
+	bucket_size = INFLUENCE_RANGE;
+	dim_x = dim_y = 0;
+}
+
+NNS_CellList::~NNS_CellList()
+{
+}
+
+/*-------------------------------- PUBLIC METHOD IMPLEMENTATIONS --------------------------------*/
+
+void NNS_CellList::add_position(float x, float y, CellId id)
+{
+	// the new position is out of its bucket until the next setup
+	positions.push_back(Position(x, y, id));
+	counter++;
+}
+
+void NNS_CellList::update_position(CellId id, float x, float y)
+{
+	// NOTE: should we use a more efficient algorithm here?
+	for (int index = 0; index < counter; index++) {
+		if (positions[index].cell_id == id) {
+			positions[index].x = x;
+			positions[index].y = y;
+			return;
+		}
+	}
+	std::cerr << "error: " << id << " not found in update_position\n";
+}
+
+void NNS_CellList::update_all_positions(const CellArray& cells)
+{
+	for (int index = 0; index < counter; index++) {
+		CellId id = positions[index].cell_id;
+		positions[index].x = cells.x[id];
+		positions[index].y = cells.y[id];
+	}
+}
+
+CellId NNS_CellList::locate_nearest(float x, float y)
+{
+	// NOTE: should we use a more efficient algorithm here?
+	float min_dist = FLT_MAX;
+	int nearest = -1;
+	Position p(x, y, (CellId) -1);
+	for (int index = 0; index < counter; index++) {
+		const Position& o = positions[index];
+		float sqr_dist = (p.x - o.x) * (p.x - o.x) + (p.y - o.y) * (p.y - o.y);
+		if (sqr_dist < min_dist) {
+			min_dist = sqr_dist;
+			nearest = index;
+		}
+	}
+	return positions[nearest].cell_id;
+}
+
+void NNS_CellList::setup()
+{
+	if (counter == 0) {
+		dim_x = dim_y = 0;
+		bucket_start.assign(1, 0);
+		return;
+	}
+
+	// grid covers the bounding box of all positions
+	float max_x, max_y;
+	min_x = max_x = positions[0].x;
+	min_y = max_y = positions[0].y;
+	for (int index = 1; index < counter; index++) {
+		const Position& p = positions[index];
+		if      (p.x < min_x) { min_x = p.x; }
+		else if (p.x > max_x) { max_x = p.x; }
+		if      (p.y < min_y) { min_y = p.y; }
+		else if (p.y > max_y) { max_y = p.y; }
+	}
+
+	// a few cells far apart would need a huge grid of empty buckets, so buckets grow until there are at most
+	// about four per position; queries stay exact, they just test more candidates
+	bucket_size = INFLUENCE_RANGE;
+	for (;;) {
+		dim_x = int((max_x - min_x) / bucket_size) + 1;
+		dim_y = int((max_y - min_y) / bucket_size) + 1;
+		if ((double) dim_x * dim_y <= 4.0 * counter + 16) {
+			break;
+		}
+		bucket_size *= 2;
+	}
+	int n_buckets = dim_x * dim_y;
+
+	// counting sort of positions by bucket: count, prefix sum, scatter
+	bucket_of.resize(counter);
+	bucket_start.assign(n_buckets + 1, 0);
+	for (int index = 0; index < counter; index++) {
+		int b = get_bucket_x(positions[index].x) + get_bucket_y(positions[index].y) * dim_x;
+		bucket_of[index] = b;
+		bucket_start[b + 1]++;
+	}
+	for (int b = 0; b < n_buckets; b++) {
+		bucket_start[b + 1] += bucket_start[b];
+	}
+
+	sorted.resize(counter);
+	for (int index = 0; index < counter; index++) {
+		// bucket_start[b] is used as the insertion point of bucket b, so it ends up as the start of bucket b + 1
+		sorted[bucket_start[bucket_of[index]]++] = positions[index];
+	}
+	for (int b = n_buckets; b > 0; b--) {
+		bucket_start[b] = bucket_start[b - 1];
+	}
+	bucket_start[0] = 0;
+
+	positions.swap(sorted);
+}
+
+void NNS_CellList::set_start_position()
+{
+	curr_position = -1;
+}
+
+bool NNS_CellList::has_next_position()
+{
+	curr_position++;
+	return curr_position < counter;
+}
+
+CellId NNS_CellList::get_current_cell_id()
+{
+	return positions[curr_position].cell_id;
+}
+
+CellId *NNS_CellList::query_current_range(float r)
+{
+	return query_position_range(curr_position, r, neighbors);
+}
+
+CellId *NNS_CellList::query_range(CellId id, float r)
+{
+	for (int index = 0; index < counter; index++) {
+		if (positions[index].cell_id == id) {
+			return query_position_range(index, r, neighbors);
+		}
+	}
+	return NULL; // 'id' does not exist
+}
+
+int NNS_CellList::get_position_count()
+{
+	return counter;
+}
+
+CellId NNS_CellList::get_cell_id(int index)
+{
+	return positions[index].cell_id;
+}
+
+CellId *NNS_CellList::query_position_range(int index, float r, CellId *result)
+{
+	const Position& current = positions[index];
+	float sqr_r = r * r;
+
+	// buckets within 'r' of the bucket of the current position
+	int reach = int(ceilf(r / bucket_size));
+	int bx = get_bucket_x(current.x);
+	int by = get_bucket_y(current.y);
+	int min_bx = std::max(bx - reach, 0), max_bx = std::min(bx + reach, dim_x - 1);
+	int min_by = std::max(by - reach, 0), max_by = std::min(by + reach, dim_y - 1);
+
+	int j = 0;
+	for (int y = min_by; y <= max_by; y++) {
+		// buckets of a row are consecutive, and so are their positions
+		int begin = bucket_start[min_bx + y * dim_x];
+		int end   = bucket_start[max_bx + y * dim_x + 1];
+		for (int k = begin; k < end && j < MAX_NEIGHBORS; k++) {
+			const Position& neighbor = positions[k];
+			float sqr_dist = (current.x - neighbor.x) * (current.x - neighbor.x) + (current.y - neighbor.y) * (current.y - neighbor.y);
+			if (sqr_dist <= sqr_r && k != index) {
+				result[j++] = neighbor.cell_id;
+			}
+		}
+	}
+	result[j] = -1; // mark list end
+
+	return result;
+}
+
+void NNS_CellList::remap_cell_ids(const std::vector<CellId>& new_ids)
+{
+	for (int index = 0; index < counter; index++) {
+		positions[index].cell_id = new_ids[positions[index].cell_id];
+	}
+}
+
+size_t NNS_CellList::get_used_memory()
+{
+	return counter * (2 * sizeof(Position) + sizeof(int)) + bucket_start.size() * sizeof(int);
+}
+
+/*-------------------------------- PRIVATE METHOD IMPLEMENTATIONS --------------------------------*/
+
+int NNS_CellList::get_bucket_x(float x) const
+{
+	int b = int((x - min_x) / bucket_size);
+	return (b < 0) ? 0 : (b >= dim_x) ? dim_x - 1 : b;
+}
+
+int NNS_CellList::get_bucket_y(float y) const
+{
+	int b = int((y - min_y) / bucket_size);
+	return (b < 0) ? 0 : (b >= dim_y) ? dim_y - 1 : b;
+}
@@ -18,14 +18,12 @@ NNS_KD_Tree::NNS_KD_Tree()
 {
 	counter = 0;
 	curr_position = -1;
-    positions = new Position[MAX_CELLS];
 
     kd_tree = new KDTree(2 /* dimension */, (*this), nanoflann::KDTreeSingleIndexAdaptorParams(100 /* max leaf */));
 }
 
 NNS_KD_Tree::~NNS_KD_Tree()
 {
-    delete[] positions; positions = NULL;
     delete (KDTree *) kd_tree; kd_tree = NULL;
 }
 
@@ -33,13 +31,8 @@ NNS_KD_Tree::~NNS_KD_Tree()
 
 void NNS_KD_Tree::add_position(float x, float y, CellId id)
 {
-	if (counter < MAX_CELLS) {
-		positions[counter].set(x, y, id);
-		counter++;
-	}
-	else {
-		std::cerr << "error: no more positions available in add_position (max " << MAX_CELLS << ")\n";
-	}
+	positions.push_back(Position(x, y, id));
+	counter++;
 }
 
 void NNS_KD_Tree::update_position(CellId id, float x, float y)
@@ -55,12 +48,12 @@ void NNS_KD_Tree::update_position(CellId id, float x, float y)
 	std::cerr << "error: " << id << " not found in update_position\n";
 }
 
-void NNS_KD_Tree::update_all_positions(Cell* cells)
+void NNS_KD_Tree::update_all_positions(const CellArray& cells)
 {
 	for (int index = 0; index < counter; index++) {
 		CellId id = positions[index].cell_id;
-		positions[index].x = cells[id].x;
-		positions[index].y = cells[id].y;
+		positions[index].x = cells.x[id];
+		positions[index].y = cells.y[id];
 	}
 }
 
@@ -104,23 +97,35 @@ CellId NNS_KD_Tree::get_current_cell_id()
 
 CellId *NNS_KD_Tree::query_current_range(float r)
 {
-	return query_position_range(curr_position, r);
+	return query_position_range(curr_position, r, neighbors);
 }
 
 CellId *NNS_KD_Tree::query_range(CellId id, float r)
 {
 	for (int index = 0; index < counter; index++) {
 		if (positions[index].cell_id == id) {
-			return query_position_range(index, r);
+			return query_position_range(index, r, neighbors);
 		}
 	}
 	return NULL; // 'id' does not exist
 }
 
-/*-------------------------------- PRIVATE METHOD IMPLEMENTATIONS --------------------------------*/
+int NNS_KD_Tree::get_position_count()
+{
+	return counter;
+}
 
-CellId *NNS_KD_Tree::query_position_range(int index, float r)
+CellId NNS_KD_Tree::get_cell_id(int index)
 {
+	return positions[index].cell_id;
+}
+
+CellId *NNS_KD_Tree::query_position_range(int index, float r, CellId *result)
+{
+	// one match list per thread, so concurrent queries do not allocate on every call
+	static thread_local std::vector<std::pair<size_t,float> > ret_matches;
+
+	float query_pt[2];
 	query_pt[0] = positions[index].x;
 	query_pt[1] = positions[index].y;
 
@@ -130,17 +135,33 @@ CellId *NNS_KD_Tree::query_position_range(int index, float r)
 	const int n = ((KDTree*) kd_tree)->radiusSearch(&query_pt[0], r * r, ret_matches, params);
 
 	int j = 0;
-	for (int i = 0; i < n; i++) {
+	for (int i = 0; i < n && j < MAX_NEIGHBORS; i++) {
 		// skip self
 		if ((int) ret_matches[i].first != index) {
 			// NOTE: this works now because index matches CellId; in the general case we would need
-			// neighbors[i] = positions[ret_matches[i].first].cell_id;
-			neighbors[j++] = ret_matches[i].first;
+			// result[i] = positions[ret_matches[i].first].cell_id;
+			result[j++] = ret_matches[i].first;
 		}
 	}
-	neighbors[j] = -1;
+	result[j] = -1;
 
-	return neighbors;
+	return result;
+}
+
+void NNS_KD_Tree::remap_cell_ids(const std::vector<CellId>& new_ids)
+{
+	// queries return position indices as cell ids, so each position moves to the index of its new id
+	std::vector<Position> remapped(counter);
+	for (int index = 0; index < counter; index++) {
+		CellId id = new_ids[positions[index].cell_id];
+		remapped[id].set(positions[index].x, positions[index].y, id);
+	}
+	positions.swap(remapped);
+}
+
+size_t NNS_KD_Tree::get_used_memory()
+{
+	return counter * sizeof(Position) + ((KDTree *) kd_tree)->usedMemory();
 }
 
 #ifdef FUTURE
@@ -16,7 +16,6 @@ NNS_SpatialSorting::NNS_SpatialSorting(int m)
 {
 	counter = 0;
 	curr_position = -1;
-	positions = new Position[MAX_CELLS];
 
 	dim_x = dim_y = 0;
 	switch (m) {
@@ -36,29 +35,30 @@ NNS_SpatialSorting::NNS_SpatialSorting(int m)
 
 NNS_SpatialSorting::~NNS_SpatialSorting()
 {
-	delete[] positions; positions = NULL;
 }
 
 /*-------------------------------- PUBLIC METHOD IMPLEMENTATIONS --------------------------------*/
 
 void NNS_SpatialSorting::add_position(float x, float y, CellId id)
 {
-	if (counter < MAX_CELLS) {
+	// positions past 'counter' pad the matrix, and sorting keeps them at its end
+	if (counter < (int) positions.size()) {
 		positions[counter].set(x, y, id);
-		counter++;
-
-		int dim = int(ceilf(sqrtf(counter)));
-		if (dim != dim_x) {
-			// NOTE: a full sort should be run by the simulation, not here
-			dim_x = dim_y = dim;
-			//std::cout << "matrix is now " << dim_x << " x " << dim_y << "\n";
-			
-			row_is_sorted.resize(dim_y);
-			col_is_sorted.resize(dim_x);
-		}
 	}
 	else {
-		std::cerr << "error: no more positions available in add_position (max " << MAX_CELLS << ")\n";
+		positions.push_back(Position(x, y, id));
+	}
+	counter++;
+
+	int dim = int(ceilf(sqrtf(counter)));
+	if (dim != dim_x) {
+		// NOTE: a full sort should be run by the simulation, not here
+		dim_x = dim_y = dim;
+		//std::cout << "matrix is now " << dim_x << " x " << dim_y << "\n";
+		
+		positions.resize(dim_x * dim_y);
+		row_is_sorted.resize(dim_y);
+		col_is_sorted.resize(dim_x);
 	}
 }
 
@@ -75,12 +75,12 @@ void NNS_SpatialSorting::update_position(CellId id, float x, float y)
 	std::cerr << "error: " << id << " not found in update_position\n";
 }
 
-void NNS_SpatialSorting::update_all_positions(Cell* cells)
+void NNS_SpatialSorting::update_all_positions(const CellArray& cells)
 {
 	for (int index = 0; index < counter; index++) {
 		CellId id = positions[index].cell_id;
-		positions[index].x = cells[id].x;
-		positions[index].y = cells[id].y;
+		positions[index].x = cells.x[id];
+		positions[index].y = cells.y[id];
 	}
 }
 
@@ -133,28 +133,38 @@ CellId NNS_SpatialSorting::get_current_cell_id()
 
 CellId *NNS_SpatialSorting::query_current_range(float r)
 {
-	return query_position_range(curr_position, r);
+	return query_position_range(curr_position, r, neighbors);
 }
 
 CellId *NNS_SpatialSorting::query_range(CellId id, float r)
 {
 	for (int index = 0; index < counter; index++) {
 		if (positions[index].cell_id == id) {
-			return query_position_range(index, r);
+			return query_position_range(index, r, neighbors);
 		}
 	}
 	return NULL; // 'id' does not exist
 }
 
-/*-------------------------------- PRIVATE METHOD IMPLEMENTATIONS --------------------------------*/
+int NNS_SpatialSorting::get_position_count()
+{
+	return counter;
+}
 
-CellId *NNS_SpatialSorting::query_position_range(int index, float r)
+CellId NNS_SpatialSorting::get_cell_id(int index)
 {
+	return positions[index].cell_id;
+}
+
+CellId *NNS_SpatialSorting::query_position_range(int index, float r, CellId *result)
+{
+	int candidates[121];
+
 	r = r * r;
 	const Position& current = positions[index];
-	get_hard_neighborhood(index);
+	get_hard_neighborhood(index, candidates);
 	int *c = candidates;
-	CellId *n = neighbors;
+	CellId *n = result;
 
 	while ((*c) != -1) {
 		const Position& neighbor = positions[(*c)];
@@ -166,10 +176,26 @@ CellId *NNS_SpatialSorting::query_position_range(int index, float r)
 	}
 	(*n) = -1; // mark list end
 
-	return neighbors;
+	return result;
 }
 
-void NNS_SpatialSorting::get_hard_neighborhood(int index)
+void NNS_SpatialSorting::remap_cell_ids(const std::vector<CellId>& new_ids)
+{
+	for (int index = 0; index < (int) positions.size(); index++) {
+		if (positions[index].cell_id != -1) { // skip padding
+			positions[index].cell_id = new_ids[positions[index].cell_id];
+		}
+	}
+}
+
+size_t NNS_SpatialSorting::get_used_memory()
+{
+	return counter * sizeof(Position);
+}
+
+/*-------------------------------- PRIVATE METHOD IMPLEMENTATIONS --------------------------------*/
+
+void NNS_SpatialSorting::get_hard_neighborhood(int index, int *candidates)
 {
 	int *c = candidates;
 	int x = index % dim_x;
@@ -10,7 +10,6 @@ NNS_SquareGrid::NNS_SquareGrid(int dim_x, int dim_y, bool wrap)
 {
 	counter = 0;
 	curr_position = -1;
-	positions = new Position[MAX_CELLS];
 
 	if (dim_x == 1 || dim_y == 1) {
 		std::cerr << "error: square grid does not accept unit dimensions: " << dim_x << " x " << dim_y << '\n';
@@ -23,20 +22,14 @@ NNS_SquareGrid::NNS_SquareGrid(int dim_x, int dim_y, bool wrap)
 
 NNS_SquareGrid::~NNS_SquareGrid()
 {
-	delete[] positions; positions = NULL;
 }
 
 /*-------------------------------- PUBLIC METHOD IMPLEMENTATIONS --------------------------------*/
 
 void NNS_SquareGrid::add_position(float x, float y, CellId id)
 {
-	if (counter < MAX_CELLS) {
-		positions[counter].set(x, y, id);
-		counter++;
-	}
-	else {
-		std::cerr << "error: no more positions available in add_position (max " << MAX_CELLS << ")\n";
-	}
+	positions.push_back(Position(x, y, id));
+	counter++;
 }
 
 void NNS_SquareGrid::update_position(CellId id, float x, float y)
@@ -52,12 +45,12 @@ void NNS_SquareGrid::update_position(CellId id, float x, float y)
 	std::cerr << "error: " << id << " not found in update_position\n";
 }
 
-void NNS_SquareGrid::update_all_positions(Cell* cells)
+void NNS_SquareGrid::update_all_positions(const CellArray& cells)
 {
 	for (int index = 0; index < counter; index++) {
 		CellId id = positions[index].cell_id;
-		positions[index].x = cells[id].x;
-		positions[index].y = cells[id].y;
+		positions[index].x = cells.x[id];
+		positions[index].y = cells.y[id];
 	}
 }
 
@@ -100,24 +93,32 @@ CellId NNS_SquareGrid::get_current_cell_id()
 
 CellId *NNS_SquareGrid::query_current_range(float r)
 {
-	return query_position_range(curr_position, r);
+	return query_position_range(curr_position, r, neighbors);
 }
 
 CellId *NNS_SquareGrid::query_range(CellId id, float r)
 {
 	for (int index = 0; index < counter; index++) {
 		if (positions[index].cell_id == id) {
-			return query_position_range(index, r);
+			return query_position_range(index, r, neighbors);
 		}
 	}
 	return NULL; // 'id' does not exist
 }
 
-/*-------------------------------- PRIVATE METHOD IMPLEMENTATIONS --------------------------------*/
+int NNS_SquareGrid::get_position_count()
+{
+	return counter;
+}
+
+CellId NNS_SquareGrid::get_cell_id(int index)
+{
+	return positions[index].cell_id;
+}
 
-CellId *NNS_SquareGrid::query_position_range(int index, UNUSED float r)
+CellId *NNS_SquareGrid::query_position_range(int index, UNUSED float r, CellId *result)
 {
-	CellId *n = neighbors;
+	CellId *n = result;
 
 	int row = index / dim_x;
 	int col = index % dim_x;
@@ -139,7 +140,7 @@ CellId *NNS_SquareGrid::query_position_range(int index, UNUSED float r)
 		(*n++) = rowp * dim_x + colp;
 		(*n) = -1; // mark list end
 
-		return neighbors;
+		return result;
 	}
 
 	if (row == dim_y - 1) {
@@ -220,5 +221,17 @@ CellId *NNS_SquareGrid::query_position_range(int index, UNUSED float r)
 	}
 	(*n) = -1; // mark list end
 
-	return neighbors;
+	return result;
+}
+
+void NNS_SquareGrid::remap_cell_ids(UNUSED const std::vector<CellId>& new_ids)
+{
+	// neighbors are found from grid coordinates, which are the cell ids themselves
+	std::cerr << "error: square grid does not support renumbering cells\n";
+	exit(1);
+}
+
+size_t NNS_SquareGrid::get_used_memory()
+{
+	return counter * sizeof(Position);
 }
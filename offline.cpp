@@ -1,16 +1,228 @@
 /*-------------------------------- INCLUDES --------------------------------*/
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <vector>
 
-//#include <time.h>
-
+#include "checkpoint.hpp"
 #include "colormap.hpp"
 #include "export.hpp"
 #include "parser.hpp"
 #include "nns_base.hpp"
+#include "profiler.hpp"
+#include "render.hpp"
 #include "simulation.hpp"
+#include "sweep.hpp"
+#include "trajectory.hpp"
 #include "types.hpp"
+#include "video.hpp"
+#include "workers.hpp"
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+// contexts run at the same time, each on a single thread: copies of the experiment with their own seed (ensemble) or
+// their own parameters (sweep)
+struct Batch {
+	std::vector<SimulationContext*> members;
+	std::vector<std::ostream*>      logs;    // members do not report their setup and progress
+	std::vector<double>             seconds; // run time of each member
+	int iterations;
+	int texture_chemical; // -1 for no texture
+};
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+// first iteration after 'iteration' that is a multiple of 'interval'
+static int next_multiple(int iteration, int interval)
+{
+	return (iteration / interval + 1) * interval;
+}
+
+// with 'view', cells are drawn as the GUI shows them instead of interpolated, at the size of the textures; snapshots
+// are numbered in order, as in the GUI
+
+static void take_snapshot(bool view, int chemical, CellExhibition cell_ex, int number)
+{
+	std::cout << "sim: snap at " << simulation.iteration << '\n';
+	if (!view) {
+		export_textures(simulation.texture_width, simulation.texture_height);
+		return;
+	}
+	std::vector<unsigned char> pixels(simulation.texture_width * simulation.texture_height * 3);
+	render_cells(default_context, chemical, cell_ex, simulation.texture_width, simulation.texture_height, &pixels[0]);
+	char filename[256];
+	snprintf(filename, sizeof(filename), "out-%02d.png", number);
+	export_png_async(filename, simulation.texture_width, simulation.texture_height, pixels);
+}
+
+static bool write_frame(VideoWriter& video, bool view, int chemical, CellExhibition cell_ex, TextureTriangulation& triangulation)
+{
+	if (!view) {
+		return export_frame(default_context, video, chemical, TEXTURE_LINEAR, &triangulation);
+	}
+	std::vector<unsigned char> pixels(video.get_width() * video.get_height() * 3);
+	render_cells(default_context, chemical, cell_ex, video.get_width(), video.get_height(), &pixels[0]);
+	return video.write(&pixels[0]);
+}
+
+// final state of a run, in the same form for single runs and ensemble members so that they can be compared
+
+static void print_summary(const SimulationContext& context)
+{
+	const Simulation& simulation = context.simulation;
+	std::cout << "seed " << simulation.seed << ": " << simulation.iteration << " iterations, " << simulation.n_cells << " cells";
+	for (int ch = 0; ch < simulation.n_chemicals; ch++) {
+		double sum = 0;
+		for (int i = 0; i < simulation.n_cells; i++) {
+			sum += simulation.curr_cells.conc[ch][i];
+		}
+		std::cout << ", " << simulation.chemicals[ch].name << " min=" << context.statistics.chem_min[ch]
+				<< " max=" << context.statistics.chem_max[ch] << " mean=" << sum / std::max(1, simulation.n_cells);
+	}
+	std::cout << '\n';
+}
+
+// members are set up before being added, either parsed with their own seed (ensemble) or copied from the default
+// context (sweep)
+
+static SimulationContext *add_member(Batch& batch, SimulationContext *member)
+{
+	std::ostream *log = new std::ostream(NULL);
+	member->log = log;
+	batch.members.push_back(member);
+	batch.logs.push_back(log);
+	batch.seconds.push_back(0);
+	return member;
+}
+
+// each thread runs a contiguous share of the members, one after the other and on a single thread each
+
+static void run_members(int thread, int n_threads, void *data)
+{
+	Batch& batch = *(Batch*) data;
+	int begin, end;
+	WorkerPool::split(batch.members.size(), thread, n_threads, begin, end);
+	for (int i = begin; i < end; i++) {
+		SimulationContext& member = *batch.members[i];
+		double start = Profiler::now();
+		simulation_run(member, batch.iterations);
+		batch.seconds[i] = (Profiler::now() - start) / 1000;
+
+		if (batch.texture_chemical != -1) {
+			char filename[256];
+			snprintf(filename, sizeof(filename), "sweep-%03d.png", i);
+			export_texture(member, filename, batch.texture_chemical, member.simulation.texture_width, member.simulation.texture_height);
+		}
+	}
+}
+
+// runs all members, set up and initialized, and returns the elapsed time in seconds
+
+static double run_batch(Batch& batch, int n_threads)
+{
+	double start = Profiler::now();
+	WorkerPool pool(n_threads);
+	pool.run(run_members, &batch);
+	return (Profiler::now() - start) / 1000;
+}
+
+static void delete_members(Batch& batch)
+{
+	for (int i = 0; i < (int) batch.members.size(); i++) {
+		simulation_done(*batch.members[i]);
+		delete batch.members[i];
+		delete batch.logs[i];
+	}
+	batch.members.clear();
+	batch.logs.clear();
+}
+
+static void run_ensemble(const char *pattern_name, int n_members, int first_seed, int n_threads, int iterations, NNSChoice nns_choice, CacheChoice cache_choice, float verlet_skin, bool reorder)
+{
+	Batch batch;
+	batch.iterations = iterations;
+	batch.texture_chemical = -1;
+	for (int i = 0; i < n_members; i++) {
+		// each member parses the experiment again, so that it draws its initial values in the same order as a run
+		// of the file with its seed
+		SimulationContext *member = add_member(batch, new SimulationContext());
+		parser_load_pattern(*member, pattern_name, first_seed + i);
+		// contexts are set up one at a time, as only running them is meant to happen concurrently
+		simulation_init(*member, nns_choice, false, 1, cache_choice, verlet_skin, reorder);
+	}
+	n_threads = std::max(1, std::min(n_threads, n_members));
+	std::cout << "ensemble: " << n_members << " runs with seeds " << first_seed << " to " << first_seed + n_members - 1
+			<< " on " << n_threads << ((n_threads > 1) ? " threads\n" : " thread\n");
+
+	double seconds = run_batch(batch, n_threads);
+
+	for (int i = 0; i < n_members; i++) {
+		print_summary(*batch.members[i]);
+	}
+	delete_members(batch);
+	std::cout << "ensemble: done in " << seconds << " s\n";
+}
+
+// one run for each combination of the values in the sweep file, summarized in a CSV file
+
+static void run_sweep(const char *sweep_name, int n_threads, int iterations, NNSChoice nns_choice, CacheChoice cache_choice, float verlet_skin, bool reorder)
+{
+	Sweep sweep;
+	sweep_load(sweep, default_context, sweep_name);
+	int n_runs = sweep.get_run_count();
+
+	std::ofstream csv(sweep.csv_name.c_str());
+	if (!csv) {
+		std::cout << "error: could not open '" << sweep.csv_name << "'\n";
+		exit(1);
+	}
+
+	Batch batch;
+	batch.iterations = iterations;
+	batch.texture_chemical = sweep.texture_chemical;
+	for (int run = 0; run < n_runs; run++) {
+		SimulationContext *member = add_member(batch, new SimulationContext(default_context));
+		sweep_apply(sweep, run, *member);
+		simulation_init(*member, nns_choice, false, 1, cache_choice, verlet_skin, reorder);
+	}
+	n_threads = std::max(1, std::min(n_threads, n_runs));
+	std::cout << "sweep: " << n_runs << " runs over " << sweep.axes.size() << " parameters on " << n_threads
+			<< ((n_threads > 1) ? " threads\n" : " thread\n");
+
+	double seconds = run_batch(batch, n_threads);
+
+	csv << "run";
+	for (int a = 0; a < (int) sweep.axes.size(); a++) {
+		csv << ',' << sweep.axes[a].name;
+	}
+	csv << ",iterations,cells,seconds";
+	for (int ch = 0; ch < simulation.n_chemicals; ch++) {
+		csv << ',' << simulation.chemicals[ch].name << "_min," << simulation.chemicals[ch].name << "_max";
+	}
+	csv << '\n';
+	for (int run = 0; run < n_runs; run++) {
+		const SimulationContext& member = *batch.members[run];
+		csv << run;
+		for (int a = 0; a < (int) sweep.axes.size(); a++) {
+			csv << ',' << sweep.get_value(run, a);
+		}
+		csv << ',' << member.simulation.iteration << ',' << member.simulation.n_cells << ',' << batch.seconds[run];
+		for (int ch = 0; ch < member.simulation.n_chemicals; ch++) {
+			csv << ',' << member.statistics.chem_min[ch] << ',' << member.statistics.chem_max[ch];
+		}
+		csv << '\n';
+	}
+	delete_members(batch);
+	std::cout << "sweep: done in " << seconds << " s, results written to " << sweep.csv_name;
+	if (sweep.texture_chemical != -1) {
+		std::cout << ", textures to sweep-NNN.png";
+	}
+	std::cout << '\n';
+}
+
 
 /*-------------------------------- MAIN FUNCTION --------------------------------*/
 
@@ -20,19 +232,153 @@ int main(int argc, char *argv[])
     	std::cout << "usage: offline [OPTION] FILE.pat\n";
     	std::cout << "  --ss         force use of spatial sorting\n";
     	std::cout << "  --kd         force use of k-d tree\n";
+    	std::cout << "  --grid       force use of cell list\n";
+    	std::cout << "  --threads N  run each step on N threads (default 1), or N ensemble or sweep runs at a time\n";
+    	std::cout << "  --nocache    do not cache neighbor lists of still cells\n";
+    	std::cout << "  --verlet S   use verlet neighbor lists with skin S for moving cells; above 2, lists survive divisions\n";
+    	std::cout << "  --reorder    renumber cells by position as the tissue grows\n";
+    	std::cout << "  --profile    print time spent in each phase of the simulation step\n";
+    	std::cout << "  --profile=json  same, as JSON\n";
+    	std::cout << "  --ensemble N run N copies of the experiment, with seeds S to S + N - 1\n";
+    	std::cout << "  --seed S     first seed of the ensemble (default 1)\n";
+    	std::cout << "  --sweep FILE run once for each combination of the parameter values in FILE\n";
+    	std::cout << "  --checkpoint FILE  save the simulation to FILE every few iterations\n";
+    	std::cout << "  --every N    iterations between checkpoints (default 1000)\n";
+    	std::cout << "  --restore FILE  continue the simulation saved in FILE; FILE.pat is then optional, for the colormap\n";
+    	std::cout << "  --trajectory FILE  record cells to FILE every few iterations\n";
+    	std::cout << "  --record N   iterations between recorded frames (default 10)\n";
+    	std::cout << "  --snap       save textures of all chemicals at the snapshots of the pattern\n";
+    	std::cout << "  --compression L  zlib level of the textures, from 0 (fastest) to 9 (smallest)\n";
+    	std::cout << "  --video FILE stream textures to FILE, in Y4M if it ends in .y4m or raw RGB otherwise; - for the output\n";
+    	std::cout << "  --frame N    iterations between video frames (default 10)\n";
+    	std::cout << "  --chemical NAME  chemical shown in the video and cell views (default the first one)\n";
+    	std::cout << "  --view       snapshots and video show the cells as the GUI does, snapshots going to out-NN.png\n";
+    	std::cout << "  --oct, --sqr, --hex-in, --hex-out, --circle  shape of the cells in views (default --oct)\n";
     	std::cout << '\n';
     	exit(1);
     }
     argv++; argc--;
 
     NNSChoice nns_choice = AUTO;
-    while ((*argv)[0] == '-') {
+    int n_threads = 1;
+    CacheChoice cache_choice = CACHE_AUTO;
+    float verlet_skin = 1;
+    bool reorder = false;
+    int ensemble = 0;
+    int first_seed = 1;
+    const char *sweep_name = NULL;
+    const char *checkpoint_name = NULL;
+    const char *restore_name = NULL;
+    int every = 1000;
+    const char *trajectory_name = NULL;
+    int record_every = 10;
+    bool snap = false;
+    int compression = -1;
+    const char *video_name = NULL;
+    int frame_every = 10;
+    const char *video_chemical = NULL;
+    bool view = false;
+    CellExhibition cell_ex = OCTOGON;
+    while (argc > 0 && (*argv)[0] == '-') {
     	if (strcmp(*argv, "--ss") == 0) {
     		nns_choice = SPATIAL_SORTING;
     	}
     	else if (strcmp(*argv, "--kd") == 0) {
     		nns_choice = KD_TREE;
     	}
+    	else if (strcmp(*argv, "--grid") == 0) {
+    		nns_choice = CELL_LIST;
+    	}
+    	else if (strcmp(*argv, "--threads") == 0 && argc > 1) {
+    		argv++; argc--;
+    		n_threads = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--nocache") == 0) {
+    		cache_choice = CACHE_OFF;
+    	}
+    	else if (strcmp(*argv, "--verlet") == 0 && argc > 1) {
+    		argv++; argc--;
+    		cache_choice = CACHE_VERLET;
+    		verlet_skin = atof(*argv);
+    	}
+    	else if (strcmp(*argv, "--reorder") == 0) {
+    		reorder = true;
+    	}
+    	else if (strcmp(*argv, "--profile") == 0) {
+    		simulation_use_profiler(PROFILE_TABLE);
+    	}
+    	else if (strcmp(*argv, "--profile=json") == 0) {
+    		simulation_use_profiler(PROFILE_JSON);
+    	}
+    	else if (strcmp(*argv, "--ensemble") == 0 && argc > 1) {
+    		argv++; argc--;
+    		ensemble = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--seed") == 0 && argc > 1) {
+    		argv++; argc--;
+    		first_seed = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--sweep") == 0 && argc > 1) {
+    		argv++; argc--;
+    		sweep_name = *argv;
+    	}
+    	else if (strcmp(*argv, "--checkpoint") == 0 && argc > 1) {
+    		argv++; argc--;
+    		checkpoint_name = *argv;
+    	}
+    	else if (strcmp(*argv, "--every") == 0 && argc > 1) {
+    		argv++; argc--;
+    		every = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--restore") == 0 && argc > 1) {
+    		argv++; argc--;
+    		restore_name = *argv;
+    	}
+    	else if (strcmp(*argv, "--trajectory") == 0 && argc > 1) {
+    		argv++; argc--;
+    		trajectory_name = *argv;
+    	}
+    	else if (strcmp(*argv, "--record") == 0 && argc > 1) {
+    		argv++; argc--;
+    		record_every = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--snap") == 0) {
+    		snap = true;
+    	}
+    	else if (strcmp(*argv, "--compression") == 0 && argc > 1) {
+    		argv++; argc--;
+    		compression = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--video") == 0 && argc > 1) {
+    		argv++; argc--;
+    		video_name = *argv;
+    	}
+    	else if (strcmp(*argv, "--frame") == 0 && argc > 1) {
+    		argv++; argc--;
+    		frame_every = atoi(*argv);
+    	}
+    	else if (strcmp(*argv, "--chemical") == 0 && argc > 1) {
+    		argv++; argc--;
+    		video_chemical = *argv;
+    	}
+    	else if (strcmp(*argv, "--view") == 0) {
+    		view = true;
+    	}
+    	else if (strcmp(*argv, "--oct") == 0) {
+    		cell_ex = OCTOGON;
+    	}
+    	else if (strcmp(*argv, "--sqr") == 0) {
+    		cell_ex = SQUARE;
+    	}
+    	else if (strcmp(*argv, "--hex-in") == 0) {
+    		cell_ex = HEXAGON_INSIDE;
+    	}
+    	else if (strcmp(*argv, "--hex-out") == 0) {
+    		cell_ex = HEXAGON_OUTSIDE;
+    	}
+    	else if (strcmp(*argv, "--circle") == 0) {
+    		cell_ex = CIRCLE;
+    	}
     	else {
     		std::cout << "unknown option '" << *argv << "'\n";
     		exit(1);
@@ -40,27 +386,153 @@ int main(int argc, char *argv[])
     	argv++; argc--;
     }
 
-    //clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time_start);
+	if ((checkpoint_name || restore_name || trajectory_name || snap || video_name) && (ensemble > 0 || sweep_name)) {
+		std::cout << "error: checkpoints, trajectories, snapshots and videos cannot be used with ensemble or sweep runs\n";
+		exit(1);
+	}
+	if (every < 1 || record_every < 1 || frame_every < 1) {
+		std::cout << "error: checkpoint, record and frame intervals must be positive\n";
+		exit(1);
+	}
+	// frames go to the standard output, so messages go to the error output instead
+	if (video_name && strcmp(video_name, "-") == 0) {
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+	if (compression < -1 || compression > 9) {
+		std::cout << "error: compression level must be between 0 and 9\n";
+		exit(1);
+	}
+	if (compression != -1) {
+		export_set_compression(compression);
+	}
+	if (argc == 0 && !restore_name) {
+		std::cout << "error: pattern file expected\n";
+		exit(1);
+	}
 
-	parser_init(*argv);
-	parser_load_pattern();
+	// a restored simulation skips parsing and setting up its cells
+	if (restore_name) {
+		if (!checkpoint_load(default_context, restore_name)) {
+			std::cout << "error: cannot restore from '" << restore_name << "'\n";
+			exit(1);
+		}
+		std::cout << "sim: restored " << simulation.n_cells << " cells at iteration " << simulation.iteration << '\n';
+	}
+	else {
+		parser_init(*argv);
+		parser_load_pattern();
+	}
 
 	colormap_init();
-	parser_load_colormap();
+	if (argc > 0) {
+		parser_init(*argv);
+		parser_load_colormap();
+	}
 	colormap_generate();
 
-	//struct timespec t;
-	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
-	//time_init = (t.tv_sec - time_start.tv_sec) * 1000.0 + (t.tv_nsec - time_start.tv_nsec) * 0.000001;
-	//time_sort = time_calc = time_draw = 0;
+	int it = (simulation.stop_at != -1) ? simulation.stop_at : 10000;
+	if (ensemble > 0) {
+		run_ensemble(*argv, ensemble, first_seed, n_threads, it, nns_choice, cache_choice, verlet_skin, reorder);
+		return 0;
+	}
+	if (sweep_name) {
+		run_sweep(sweep_name, n_threads, it, nns_choice, cache_choice, verlet_skin, reorder);
+		return 0;
+	}
 
-	simulation_init(nns_choice);
+	simulation_init(nns_choice, false, n_threads, cache_choice, verlet_skin, reorder);
+	// snapshots are encoded in the background while the simulation goes on
+	if (snap) {
+		export_start_encoders(1);
+	}
+	TrajectoryWriter trajectory;
+	if (trajectory_name && !(trajectory.open(trajectory_name, simulation, record_every) && trajectory.record(simulation))) {
+		std::cout << "error: cannot write trajectory '" << trajectory_name << "'\n";
+		exit(1);
+	}
+	int chemical = video_chemical ? -1 : 0;
+	for (int ch = 0; video_chemical && ch < simulation.n_chemicals; ch++) {
+		if (simulation.chemicals[ch].name == video_chemical) {
+			chemical = ch;
+		}
+	}
+	if (chemical == -1) {
+		std::cout << "error: unknown chemical '" << video_chemical << "'\n";
+		exit(1);
+	}
+	// frames share the triangulation of the tissue from one to the next, like snapshots
+	VideoWriter video;
+	TextureTriangulation video_triangulation;
+	if (video_name && !(video.open(video_name, simulation.texture_width, simulation.texture_height) &&
+			write_frame(video, view, chemical, cell_ex, video_triangulation))) {
+		std::cout << "error: cannot write video '" << video_name << "'\n";
+		exit(1);
+	}
 
-	int it = (simulation.stop_at != -1) ? simulation.stop_at : 10000;
-	simulation_run(it);
+	// snapshots already taken by a restored simulation are skipped; consecutive ones share most of the triangulation
+	// of the tissue, which is kept by export_textures
+	int n_snaps = snap ? (int) simulation.snap_at.size() : 0;
+	int next_snap = 0;
+	while (next_snap < n_snaps && simulation.snap_at[next_snap] < simulation.iteration) {
+		next_snap++;
+	}
+	if (next_snap < n_snaps && simulation.snap_at[next_snap] == simulation.iteration) {
+		take_snapshot(view, chemical, cell_ex, next_snap);
+		next_snap++;
+	}
+
+	// run up to each checkpoint, each recorded frame, each video frame and each snapshot
+	while (simulation.iteration < it && simulation.is_running) {
+		int next = it;
+		if (next_snap < n_snaps) {
+			next = std::min(next, simulation.snap_at[next_snap]);
+		}
+		if (checkpoint_name) {
+			next = std::min(next, next_multiple(simulation.iteration, every));
+		}
+		if (trajectory_name) {
+			next = std::min(next, next_multiple(simulation.iteration, record_every));
+		}
+		if (video_name) {
+			next = std::min(next, next_multiple(simulation.iteration, frame_every));
+		}
+		simulation_run(next - simulation.iteration);
+
+		bool last = (simulation.iteration >= it || !simulation.is_running);
+		if (checkpoint_name && (simulation.iteration % every == 0 || last) && !checkpoint_save(default_context, checkpoint_name)) {
+			std::cout << "error: cannot write checkpoint '" << checkpoint_name << "'\n";
+			exit(1);
+		}
+		if (trajectory_name && !trajectory.record(simulation)) {
+			std::cout << "error: cannot write trajectory '" << trajectory_name << "'\n";
+			exit(1);
+		}
+		if (video_name && simulation.iteration % frame_every == 0 &&
+				!write_frame(video, view, chemical, cell_ex, video_triangulation)) {
+			std::cout << "error: cannot write video '" << video_name << "'\n";
+			exit(1);
+		}
+		if (next_snap < n_snaps && simulation.snap_at[next_snap] == simulation.iteration) {
+			take_snapshot(view, chemical, cell_ex, next_snap);
+			next_snap++;
+		}
+	}
+	if (!trajectory.close()) {
+		std::cout << "error: cannot write trajectory '" << trajectory_name << "'\n";
+		exit(1);
+	}
+	if (!video.close()) {
+		std::cout << "error: cannot write video '" << video_name << "'\n";
+		exit(1);
+	}
+	if (video_name) {
+		std::cout << "sim: " << video.get_frame_count() << " frames of " << video.get_width() << " by " << video.get_height() << " in '" << video_name << "'\n";
+	}
 	//export_texture(256);
 	//std::cout << "stop at " << it << "  " << simulation.iteration << '\n';
 
+	export_stop_encoders();
+	print_summary(default_context);
 	simulation_done();
 
     return 0;
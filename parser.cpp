@@ -11,13 +11,18 @@
 
 #include "parser.hpp"
 
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+// cells of shapes marked by letters, paired as mirrors: upper case with the matching lower case
+struct MirrorSequences {
+	std::vector<int> upper[26];
+	std::vector<int> lower[26];
+};
+
 /*-------------------------------- LOCAL VARIABLES --------------------------------*/
 
 static const char *file_name = NULL;
 
-static std::vector<int> mirror_seq_upper[26];
-static std::vector<int> mirror_seq_lower[26];
-
 /*-------------------------------- LOCAL UTILITY FUNCTIONS --------------------------------*/
 
 static std::string trim(std::string str)
@@ -53,7 +58,7 @@ static void error(std::string message, int line_num = 0)
 	exit(1);
 }
 
-static int find_chemical(std::string name)
+static int find_chemical(const Simulation& simulation, std::string name)
 {
 	for (int ch = 0; ch < simulation.n_chemicals; ch++) {
 		if (simulation.chemicals[ch].name == name) {
@@ -64,9 +69,9 @@ static int find_chemical(std::string name)
 	return -1;
 }
 
-static int add_mapping(std::string name, int line_num)
+static int add_mapping(Simulation& simulation, std::string name, int line_num)
 {
-	if (find_chemical(name) != -1) {
+	if (find_chemical(simulation, name) != -1) {
 		error("there is already a chemical with name " + name, line_num);
 	}
 	int i;
@@ -81,7 +86,7 @@ static int add_mapping(std::string name, int line_num)
 	return i;
 }
 
-static int find_mapping(std::string name)
+static int find_mapping(const Simulation& simulation, std::string name)
 {
 	for (int i = 0; i < (int) simulation.mappings.size(); i++) {
 		if (simulation.mappings[i] == name) {
@@ -92,7 +97,7 @@ static int find_mapping(std::string name)
 	return -1;
 }
 
-static void get_parameter(std::stringstream& ss, Parameter& par, float& val, int line_num)
+static void get_parameter(const Simulation& simulation, std::stringstream& ss, Parameter& par, float& val, int line_num)
 {
 	std::string word;
 	ss >> word;
@@ -119,7 +124,7 @@ static void get_parameter(std::stringstream& ss, Parameter& par, float& val, int
 	}
 
 	// check for a chemical
-	int ch = find_chemical(word);
+	int ch = find_chemical(simulation, word);
 	if (ch != -1) {
 		ss >> word;
 		if (word == "conc") {
@@ -136,7 +141,7 @@ static void get_parameter(std::stringstream& ss, Parameter& par, float& val, int
 	}
 
 	// check for a mapping
-	int i = find_mapping(word);
+	int i = find_mapping(simulation, word);
 	if (i != -1) {
 		par = (Parameter) (i + 2 * MAX_CHEMICALS);
 	}
@@ -145,8 +150,10 @@ static void get_parameter(std::stringstream& ss, Parameter& par, float& val, int
 	}
 }
 
-static void create_shape(std::string shape, float center_x, float center_y, bool fixed)
+static void create_shape(SimulationContext& context, MirrorSequences& mirrors, std::string shape, float center_x, float center_y, bool fixed)
 {
+	std::ostream& log = *context.log;
+
 	std::ifstream file(shape.c_str());
 	if (! file.is_open()) {
 		error("cannot open shape file '" + shape + "'");
@@ -161,7 +168,7 @@ static void create_shape(std::string shape, float center_x, float center_y, bool
 		}
 		count_y++;
 	}
-	std::cout << "shape: read " << count_x << " by " << count_y << " characters\n";
+	log << "shape: read " << count_x << " by " << count_y << " characters\n";
 
 	// create cells marked by alphabetic characters
 	int cy = 0;
@@ -173,7 +180,7 @@ static void create_shape(std::string shape, float center_x, float center_y, bool
 		for (int cx = 0; cx < len; cx++) {
 			if (isalpha(line[cx])) {
 	    		float x = center_x + (cx - count_x / 2.0) * 2;
-	    		CellId id = simulation_create_cell(x, y, fixed);
+	    		CellId id = simulation_create_cell(context, x, y, fixed);
 
 	    		// standard cell
 	    		if (line[cx] == 'o' || line[cx] == 'O') {
@@ -182,10 +189,10 @@ static void create_shape(std::string shape, float center_x, float center_y, bool
 
 	    		// mirror cell
 	    		if (isupper(line[cx])) {
-	    			mirror_seq_upper[line[cx] - 'A'].push_back(id);
+	    			mirrors.upper[line[cx] - 'A'].push_back(id);
 	    		}
 	    		else if (islower(line[cx])) {
-	    			mirror_seq_lower[line[cx] - 'a'].push_back(id);
+	    			mirrors.lower[line[cx] - 'a'].push_back(id);
 	    		}
 			}
 		}
@@ -195,11 +202,11 @@ static void create_shape(std::string shape, float center_x, float center_y, bool
 	// insert mirror pairs from matching alphabetic sequences
 	for (int i = 0; i < 26; i++) {
 		int reverse = -1;
-		while (mirror_seq_upper[i].size() && mirror_seq_lower[i].size())
+		while (mirrors.upper[i].size() && mirrors.lower[i].size())
 		{
 			if (reverse == -1) {
-				if (mirror_seq_lower[i].front() < mirror_seq_upper[i].front()) {
-					std::cout << "shape: reversed matching between '" << char('A' + i) << "' and '" << char('a' + i) << "'\n";
+				if (mirrors.lower[i].front() < mirrors.upper[i].front()) {
+					log << "shape: reversed matching between '" << char('A' + i) << "' and '" << char('a' + i) << "'\n";
 					reverse = 1;
 				}
 				else {
@@ -210,29 +217,29 @@ static void create_shape(std::string shape, float center_x, float center_y, bool
 			// if a lower case character precedes an upper case character, reverse the matching order
 			CellId id1, id2;
 			if (reverse == 0) {
-				id1 = (CellId) mirror_seq_upper[i].front();
-				id2 = (CellId) mirror_seq_lower[i].front();
-				mirror_seq_upper[i].erase(mirror_seq_upper[i].begin());
-				mirror_seq_lower[i].erase(mirror_seq_lower[i].begin());
+				id1 = (CellId) mirrors.upper[i].front();
+				id2 = (CellId) mirrors.lower[i].front();
+				mirrors.upper[i].erase(mirrors.upper[i].begin());
+				mirrors.lower[i].erase(mirrors.lower[i].begin());
 			}
 			else {
-				id1 = (CellId) mirror_seq_upper[i].front();
-				id2 = (CellId) mirror_seq_lower[i].back();
-				mirror_seq_upper[i].erase(mirror_seq_upper[i].begin());
-				mirror_seq_lower[i].pop_back();
+				id1 = (CellId) mirrors.upper[i].front();
+				id2 = (CellId) mirrors.lower[i].back();
+				mirrors.upper[i].erase(mirrors.upper[i].begin());
+				mirrors.lower[i].pop_back();
 			}
-			simulation_define_mirror_pair(id1, id2);
+			simulation_define_mirror_pair(context, id1, id2);
 			//std::cout << id1 << " -- " << id2 << '\n';
 		}
-		if (mirror_seq_upper[i].size()) {
-			std::cout << "shape: found " << mirror_seq_upper[i].size() << " extra cell(s) for '" << char('A' + i) << "'\n";
-			for(unsigned int j = 0; j < mirror_seq_upper[i].size(); j++) {
-				std::cout << mirror_seq_upper[i][j] << ' ';
+		if (mirrors.upper[i].size()) {
+			log << "shape: found " << mirrors.upper[i].size() << " extra cell(s) for '" << char('A' + i) << "'\n";
+			for(unsigned int j = 0; j < mirrors.upper[i].size(); j++) {
+				log << mirrors.upper[i][j] << ' ';
 			}
-			std::cout << '\n';
+			log << '\n';
 		}
-		if (mirror_seq_lower[i].size()) {
-			std::cout << "shape: found " << mirror_seq_lower[i].size() << " extra cell(s) for '" << char('a' + i) << "'\n";
+		if (mirrors.lower[i].size()) {
+			log << "shape: found " << mirrors.lower[i].size() << " extra cell(s) for '" << char('a' + i) << "'\n";
 		}
 	}
 }
@@ -246,9 +253,20 @@ void parser_init(const char *name)
 
 void parser_load_pattern()
 {
-	std::ifstream file(file_name);
+	parser_load_pattern(default_context, file_name);
+}
+
+// with 'override_seed', every 'use seed' of the file uses 'forced_seed' instead; all the state of a load is local, so
+// that contexts can be loaded on several threads at once
+static void load_pattern(SimulationContext& context, const char *name, bool override_seed, int forced_seed)
+{
+	Simulation& simulation = context.simulation;
+	std::ostream& log = *context.log;
+	MirrorSequences mirrors;
+
+	std::ifstream file(name);
 	if (! file.is_open()) {
-		error("cannot open pattern file '" + std::string(file_name) + "'");
+		error("cannot open pattern file '" + std::string(name) + "'");
 	}
 
 	int n = 0;
@@ -270,7 +288,7 @@ void parser_load_pattern()
 		    if (word == "chemical") {
 		    	std::string name;
 		    	ss >> name;
-		    	if (find_chemical(name) != -1) {
+		    	if (find_chemical(simulation, name) != -1) {
 		    		error("chemical " + name + " already defined", n);
 		    	}
 		    	float limit = FLT_MAX;
@@ -283,14 +301,14 @@ void parser_load_pattern()
 		    	if (word == "anisotropic") {
 		    		anisotropic = true;
 		    	}
-		    	simulation_define_chemical(name, limit, anisotropic);
+		    	simulation_define_chemical(context, name, limit, anisotropic);
 		    	//std::cout << "chem " << simulation.chemicals[ch] << " has limit=" << simulation.limit[ch]
 		    	//          << ((simulation.anisotropic[ch])? " anisotropic" : " isotropic") << '\n';
 		    }
 		    else if (word == "division_limit") {
 		    	int division_limit;
 		    	ss >> division_limit;
-		    	simulation_define_division_limit(division_limit);
+		    	simulation_define_division_limit(context, division_limit);
 		    	//std::cout << "division_limit is "<< division_limit << '\n';
 		    }
 		    else if (word == "domain") {
@@ -303,20 +321,20 @@ void parser_load_pattern()
 			    		ss >> factor;
 			    		simulation.domain_packed_factor = factor;
 			    	}
-			    	std::cout << "domain is packed with factor " << simulation.domain_packed_factor << '\n';
+			    	log << "domain is packed with factor " << simulation.domain_packed_factor << '\n';
 		    	}
 		    	else {
 		    		float width, height;
 		    		std::stringstream(word) >> width;
 		    		ss >> height;
-		    		simulation_define_domain(width, height);
-		    		std::cout << "domain is "<< width << " by " << height << '\n';
+		    		simulation_define_domain(context, width, height);
+		    		log << "domain is "<< width << " by " << height << '\n';
 		    	}
 		    }
 		    else if (word == "time_step") {
 		    	float time_step;
 		    	ss >> time_step;
-		    	simulation_define_time_step(time_step);
+		    	simulation_define_time_step(context, time_step);
 		    	//std::cout << "time step is "<< time_step << '\n';
 		    }
 	    	else {
@@ -328,7 +346,7 @@ void parser_load_pattern()
 	    	ss >> word;
 		    if (word == "chemical") {
 		    	ss >> word;
-		    	int ch = find_chemical(word);
+		    	int ch = find_chemical(simulation, word);
 		    	if (ch == -1) {
 		    		error("unknown chemical " + word, n);
 		    	}
@@ -341,7 +359,7 @@ void parser_load_pattern()
 		    			ss >> deviation;
 		    			ss >> word;
 		    		}
-		    		simulation_use_chemical_concentration(ch, value, deviation);
+		    		simulation_use_chemical_concentration(context, ch, value, deviation);
 		    	}
 		    	if (word == "diff") {
 		    		float value = 0, deviation = 0;
@@ -350,7 +368,7 @@ void parser_load_pattern()
 		    		if (word == "dev") {
 		    			ss >> deviation;
 		    		}
-		    		simulation_use_chemical_diffusion(ch, value, deviation);
+		    		simulation_use_chemical_diffusion(context, ch, value, deviation);
 		    	}
 		    	//std::cout << "chem " << simulation.chemicals[ch] << " has conc=" << concentration
 		    	//          << " diff=" << diffusion << '\n';
@@ -358,7 +376,7 @@ void parser_load_pattern()
 		    else if (word == "polarity") {
 		    	ss >> word;
 		    	if (word == "none") {
-		    		simulation_use_polarity(FLT_MAX, 0);
+		    		simulation_use_polarity(context, FLT_MAX, 0);
 		    	}
 		    	else {
 		    		float angle = strtod(word.c_str(), NULL);
@@ -367,13 +385,13 @@ void parser_load_pattern()
 		    		if (word == "dev") {
 		    			ss >> deviation;
 		    		}
-		    		simulation_use_polarity(angle, deviation);
+		    		simulation_use_polarity(context, angle, deviation);
 		    	}
 		    }
 		    else if (word == "seed") {
-		    	int seed;
-		    	ss >> seed;
-		    	simulation_use_seed(seed);
+		    	int file_seed;
+		    	ss >> file_seed;
+		    	simulation_use_seed(context, override_seed ? forced_seed : file_seed);
 		    	//std::cout << "seed is "<< seed << '\n';
 		    }
 		    else {
@@ -392,7 +410,7 @@ void parser_load_pattern()
 				if (word == "fixed") {
 					fixed = true;
 				}
-				simulation_create_cell(x, y, fixed);
+				simulation_create_cell(context, x, y, fixed);
 		    	//std::cout << "new cell created at " << x << "," << y << '\n';
 		    }
 		    else if (word == "sqr_grid") {
@@ -420,7 +438,7 @@ void parser_load_pattern()
 		    	if (word == "wrap") {
 		    		wrap = true;
 		    	}
-		    	simulation_create_square_grid(count_x, count_y, x, y, dev, fixed, wrap);
+		    	simulation_create_square_grid(context, count_x, count_y, x, y, dev, fixed, wrap);
 		    	//std::cout << "new " << count_x << " by " << count_y << " square grid created at " << x << "," << y << " dev=" << dev << '\n';
 		    }
 		    else if (word == "sqr_circle") {
@@ -443,7 +461,7 @@ void parser_load_pattern()
 		    	if (word == "fixed") {
 		    		fixed = true;
 		    	}
-		    	simulation_create_square_circle(count, x, y, dev, fixed);
+		    	simulation_create_square_circle(context, count, x, y, dev, fixed);
 		    	//std::cout << "new square circle with diameter " << count << " created at " << x << "," << y << " dev=" << dev << '\n';
 		    }
 		    else if (word == "hex_grid") {
@@ -467,7 +485,7 @@ void parser_load_pattern()
 		    	if (word == "fixed") {
 		    		fixed = true;
 		    	}
-		    	simulation_create_hexagonal_grid(count_x, count_y, x, y, dev, fixed);
+		    	simulation_create_hexagonal_grid(context, count_x, count_y, x, y, dev, fixed);
 		    	//std::cout << "new " << count_x << " by " << count_y << " hexagonal grid created at " << x << "," << y << " dev=" << dev << '\n';
 		    }
 		    else if (word == "hex_circle") {
@@ -490,7 +508,7 @@ void parser_load_pattern()
 		    	if (word == "fixed") {
 		    		fixed = true;
 		    	}
-		    	simulation_create_hexagonal_circle(count, x, y, dev, fixed);
+		    	simulation_create_hexagonal_circle(context, count, x, y, dev, fixed);
 		    	//std::cout << "new hexagonal circle with diameter " << count << " created at " << x << "," << y << " dev=" << dev << '\n';
 		    }
 		    else if (word == "shape") {
@@ -511,7 +529,7 @@ void parser_load_pattern()
 		    	if (word == "fixed") {
 		    		fixed = true;
 		    	}
-		    	create_shape(shape, x, y, fixed);
+		    	create_shape(context, mirrors, shape, x, y, fixed);
 		    	//std::cout << "new shape from '" << shape << "' created at " << x << "," << y << " dev=" << dev << '\n';
 		    }
 	    	else {
@@ -530,7 +548,7 @@ void parser_load_pattern()
 		    	ss >> word;
 		    	if (word == "chemical") {
 			    	ss >> word;
-			    	int ch = find_chemical(word);
+			    	int ch = find_chemical(simulation, word);
 			    	if (ch == -1) {
 			    		error("unknown chemical " + word, n);
 			    	}
@@ -546,7 +564,7 @@ void parser_load_pattern()
 			    			ss >> dev;
 			    			ss >> word;
 			    		}
-			    		simulation_set_cell_concentration(id, ch, value, dev);
+			    		simulation_set_cell_concentration(context, id, ch, value, dev);
 			    	}
 			    	if (word == "diff") {
 			    		float value = 0, dev = 0;
@@ -556,14 +574,14 @@ void parser_load_pattern()
 			    			ss >> dev;
 			    			ss >> word;
 			    		}
-			    		simulation_set_cell_diffusion(id, ch, value, dev);
+			    		simulation_set_cell_diffusion(context, id, ch, value, dev);
 			    	}
 		    	}
 			    if (word == "polarity") {
 			    	ss >> word;
 			    	if (word == "none") {
 			    		ss >> word;
-			    		simulation_set_cell_polarity(id, FLT_MAX, 0);
+			    		simulation_set_cell_polarity(context, id, FLT_MAX, 0);
 			    	}
 			    	else {
 			    		float angle = strtod(word.c_str(), NULL);
@@ -573,11 +591,11 @@ void parser_load_pattern()
 			    			ss >> deviation;
 			    			ss >> word;
 			    		}
-			    		simulation_set_cell_polarity(id, angle, deviation);
+			    		simulation_set_cell_polarity(context, id, angle, deviation);
 			    	}
 			    }
 		    	if (word == "fixed") {
-		    		simulation_set_cell_fixed(id, true);
+		    		simulation_set_cell_fixed(context, id, true);
 		    	}
 		    }
 		    else if (word == "cells") {
@@ -597,7 +615,7 @@ void parser_load_pattern()
 		    	ss >> word;
 		    	if (word == "chemical") {
 		    		ss >> word;
-		    		int ch = find_chemical(word);
+		    		int ch = find_chemical(simulation, word);
 		    		if (ch == -1) {
 		    			error("unknown chemical " + word, n);
 		    		}
@@ -614,7 +632,7 @@ void parser_load_pattern()
 		    				ss >> word;
 		    			}
 		    			for (CellId id = id1; id <= id2; id++) {
-		    				simulation_set_cell_concentration(id, ch, value, dev);
+		    				simulation_set_cell_concentration(context, id, ch, value, dev);
 		    			}
 		    		}
 		    		if (word == "diff") {
@@ -626,7 +644,7 @@ void parser_load_pattern()
 		    				ss >> word;
 		    			}
 		    			for (CellId id = id1; id <= id2; id++) {
-		    				simulation_set_cell_diffusion(id, ch, value, dev);
+		    				simulation_set_cell_diffusion(context, id, ch, value, dev);
 		    			}
 		    		}
 		    	}
@@ -635,7 +653,7 @@ void parser_load_pattern()
 			    	if (word == "none") {
 			    		ss >> word;
 			    		for (CellId id = id1; id <= id2; id++) {
-			    			simulation_set_cell_polarity(id, FLT_MAX, 0);
+			    			simulation_set_cell_polarity(context, id, FLT_MAX, 0);
 			    		}
 			    	}
 			    	else {
@@ -647,13 +665,13 @@ void parser_load_pattern()
 			    			ss >> word;
 			    		}
 			    		for (CellId id = id1; id <= id2; id++) {
-			    			simulation_set_cell_polarity(id, angle, deviation);
+			    			simulation_set_cell_polarity(context, id, angle, deviation);
 			    		}
 			    	}
 			    }
 		    	if (word == "fixed") {
 		    		for (CellId id = id1; id <= id2; id++) {
-		    			simulation_set_cell_fixed(id, true);
+		    			simulation_set_cell_fixed(context, id, true);
 		    		}
 		    	}
 		    }
@@ -679,37 +697,37 @@ void parser_load_pattern()
 		    }
 		    else if (word == "if") {
 		    	// extract first parameter
-		    	get_parameter(ss, rule.pr_par[0], rule.pr_val[0], n);
+		    	get_parameter(simulation, ss, rule.pr_par[0], rule.pr_val[0], n);
 		    	// extract comparison operator and other parameter(s)
 		    	ss >> word;
 		    	if (word == "==") {
 		    		rule.predicate = IF_EQUAL;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
 		    	}
 		    	else if (word == "!=") {
 		    		rule.predicate = IF_NOT_EQUAL;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
 		    	}
 		    	else if (word == "<") {
 		    		rule.predicate = IF_LESS_THAN;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
 		    	}
 		    	else if (word == "<=") {
 		    		rule.predicate = IF_LESS_EQUAL;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
 		    	}
 		    	else if (word == ">") {
 		    		rule.predicate = IF_GREATER_THAN;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
 		    	}
 		    	else if (word == ">=") {
 		    		rule.predicate = IF_GREATER_EQUAL;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
 		    	}
 		    	else if (word == "in") {
 		    		rule.predicate = IF_IN_INTERVAL;
-			    	get_parameter(ss, rule.pr_par[1], rule.pr_val[1], n);
-			    	get_parameter(ss, rule.pr_par[2], rule.pr_val[2], n);
+			    	get_parameter(simulation, ss, rule.pr_par[1], rule.pr_val[1], n);
+			    	get_parameter(simulation, ss, rule.pr_par[2], rule.pr_val[2], n);
 		    	}
 	    		else {
 	    			error("unknown comparison operator " + word, n);
@@ -717,7 +735,7 @@ void parser_load_pattern()
 		    }
 		    else if (word == "probability") {
 		    	rule.predicate = PROBABILITY;
-		    	get_parameter(ss, rule.pr_par[0], rule.pr_val[0], n);
+		    	get_parameter(simulation, ss, rule.pr_par[0], rule.pr_val[0], n);
 		    }
     		else {
     			error("unknown predicate " + word, n);
@@ -726,20 +744,20 @@ void parser_load_pattern()
 	    	ss >> word;
 		    if (word == "react") {
 		    	ss >> word;
-		    	int ch = find_chemical(word);
+		    	int ch = find_chemical(simulation, word);
 		    	if (ch == -1) {
 		    		error("unknown chemical " + word, n);
 		    	}
 		    	rule.ac_par[0] = (Parameter) ch;
 		    	ss >> word;
-		    	ch = find_chemical(word);
+		    	ch = find_chemical(simulation, word);
 		    	if (ch == -1) {
 		    		error("unknown chemical " + word, n);
 		    	}
 		    	rule.ac_par[1] = (Parameter) ch;
 		    	ss >> word;
 		    	if (word == "scale") {
-			    	get_parameter(ss, rule.ac_par[2], rule.ac_val[2], n);
+			    	get_parameter(simulation, ss, rule.ac_par[2], rule.ac_val[2], n);
 			    	ss >> word;
 		    	}
 		    	else {
@@ -750,14 +768,14 @@ void parser_load_pattern()
 		    		rule.action = REACT_GS;
 			    	ss >> word;
 				    if (word == "f") {
-				    	get_parameter(ss, rule.ac_par[3], rule.ac_val[3], n);
+				    	get_parameter(simulation, ss, rule.ac_par[3], rule.ac_val[3], n);
 				    }
 				    else {
 				    	error("parameter 'f' expected", n);
 				    }
 			    	ss >> word;
 				    if (word == "k") {
-				    	get_parameter(ss, rule.ac_par[4], rule.ac_val[4], n);
+				    	get_parameter(simulation, ss, rule.ac_par[4], rule.ac_val[4], n);
 				    }
 				    else {
 				    	error("parameter 'k' expected", n);
@@ -767,14 +785,14 @@ void parser_load_pattern()
 		    		rule.action = REACT_TU;
 			    	ss >> word;
 				    if (word == "alpha") {
-				    	get_parameter(ss, rule.ac_par[3], rule.ac_val[3], n);
+				    	get_parameter(simulation, ss, rule.ac_par[3], rule.ac_val[3], n);
 				    }
 				    else {
 				    	error("parameter 'alpha' expected", n);
 				    }
 			    	ss >> word;
 				    if (word == "beta") {
-				    	get_parameter(ss, rule.ac_par[4], rule.ac_val[4], n);
+				    	get_parameter(simulation, ss, rule.ac_par[4], rule.ac_val[4], n);
 				    }
 				    else {
 				    	error("parameter 'beta' expected", n);
@@ -784,14 +802,14 @@ void parser_load_pattern()
 		    		rule.action = REACT_LI;
 			    	ss >> word;
 				    if (word == "a") {
-				    	get_parameter(ss, rule.ac_par[3], rule.ac_val[3], n);
+				    	get_parameter(simulation, ss, rule.ac_par[3], rule.ac_val[3], n);
 				    }
 				    else {
 				    	error("parameter 'a' expected", n);
 				    }
 			    	ss >> word;
 				    if (word == "b") {
-				    	get_parameter(ss, rule.ac_par[4], rule.ac_val[4], n);
+				    	get_parameter(simulation, ss, rule.ac_par[4], rule.ac_val[4], n);
 				    }
 				    else {
 				    	error("parameter 'b' expected", n);
@@ -801,21 +819,21 @@ void parser_load_pattern()
 		    		rule.action = REACT_CU;
 			    	ss >> word;
 				    if (word == "a") {
-				    	get_parameter(ss, rule.ac_par[3], rule.ac_val[3], n);
+				    	get_parameter(simulation, ss, rule.ac_par[3], rule.ac_val[3], n);
 				    }
 				    else {
 				    	error("parameter 'a' expected", n);
 				    }
 			    	ss >> word;
 				    if (word == "b") {
-				    	get_parameter(ss, rule.ac_par[4], rule.ac_val[4], n);
+				    	get_parameter(simulation, ss, rule.ac_par[4], rule.ac_val[4], n);
 				    }
 				    else {
 				    	error("parameter 'b' expected", n);
 				    }
 			    	ss >> word;
 				    if (word == "c") {
-				    	get_parameter(ss, rule.ac_par[5], rule.ac_val[5], n);
+				    	get_parameter(simulation, ss, rule.ac_par[5], rule.ac_val[5], n);
 				    }
 				    else {
 				    	error("parameter 'c' expected", n);
@@ -825,7 +843,7 @@ void parser_load_pattern()
 		    else if (word == "change") {
 		    	rule.action = CHANGE;
 		    	// target parameter
-		    	get_parameter(ss, rule.ac_par[0], rule.ac_val[0], n);
+		    	get_parameter(simulation, ss, rule.ac_par[0], rule.ac_val[0], n);
 		    	if (rule.ac_par[0] == CONSTANT) {
 		    		error("cannot change constant value", n);
 		    	}
@@ -842,7 +860,7 @@ void parser_load_pattern()
 		    		error("cannot change map value", n);
 		    	}
 		    	// change quantity
-		    	get_parameter(ss, rule.ac_par[1], rule.ac_val[1], n);
+		    	get_parameter(simulation, ss, rule.ac_par[1], rule.ac_val[1], n);
 		    	ss >> word;
 		    	if (word == "dev") {
 		    		rule.ac_par[2] = CONSTANT;
@@ -860,7 +878,7 @@ void parser_load_pattern()
 		    	rule.action = MAP;
 		    	float a, b;
 		    	// source parameter and interval
-		    	get_parameter(ss, rule.ac_par[0], rule.ac_val[0], n);
+		    	get_parameter(simulation, ss, rule.ac_par[0], rule.ac_val[0], n);
 		    	ss >> a >> b;
 		    	if (a == b) {
 		    		error("map source limits cannot be equal", n);
@@ -874,7 +892,7 @@ void parser_load_pattern()
 	    		}
 		    	// destination variable and range
 	    		ss >> word;
-	    		rule.ac_par[3] = (Parameter) (add_mapping(word, n) + 2 * MAX_CHEMICALS);
+	    		rule.ac_par[3] = (Parameter) (add_mapping(simulation, word, n) + 2 * MAX_CHEMICALS);
 		    	ss >> a >> b;
 	    		rule.ac_par[4] = rule.ac_par[5] = CONSTANT;
 	    		rule.ac_val[4] = a;
@@ -883,7 +901,7 @@ void parser_load_pattern()
 		    else if (word == "polarize") {
 		    	rule.action = POLARIZE;
 		    	// source parameter
-		    	get_parameter(ss, rule.ac_par[0], rule.ac_val[0], n);
+		    	get_parameter(simulation, ss, rule.ac_par[0], rule.ac_val[0], n);
 		    	if (rule.ac_par[0] < 0 || rule.ac_par[0] >= MAX_CHEMICALS) {
 		    		error("polarity can only be based on a chemical concentration", n);
 		    	}
@@ -892,7 +910,7 @@ void parser_load_pattern()
 		    	rule.action = DIVIDE;
 		    	ss >> word;
 			    if (word == "direction") {
-			    	get_parameter(ss, rule.ac_par[0], rule.ac_val[0], n);
+			    	get_parameter(simulation, ss, rule.ac_par[0], rule.ac_val[0], n);
 			    	ss >> word;
 			    	if (word == "dev") {
 			    		rule.ac_par[1] = CONSTANT;
@@ -911,7 +929,7 @@ void parser_load_pattern()
 		    }
 		    else if (word == "move") {
 		    	rule.action = MOVE;
-		    	get_parameter(ss, rule.ac_par[0], rule.ac_val[0], n);
+		    	get_parameter(simulation, ss, rule.ac_par[0], rule.ac_val[0], n);
 		    	ss >> word;
 		    	if (word == "dev") {
 		    		rule.ac_par[1] = CONSTANT;
@@ -928,7 +946,7 @@ void parser_load_pattern()
     		else {
     			error("unknown action " + word, n);
     		}
-		    simulation_add_rule(rule);
+		    simulation_add_rule(context, rule);
 		    //std::cout << "added rule: " << rule << '\n';
 	    }
 	    else if (word == "colormap") {
@@ -1020,6 +1038,17 @@ void parser_load_pattern()
 	// no need to close file; let the destructor do it (so it can handle any exceptions raised)
 }
 
+void parser_load_pattern(SimulationContext& context, const char *name)
+{
+	load_pattern(context, name, false, 0);
+}
+
+void parser_load_pattern(SimulationContext& context, const char *name, int seed)
+{
+	simulation_use_seed(context, seed);
+	load_pattern(context, name, true, seed);
+}
+
 void parser_load_colormap()
 {
 	std::ifstream file(file_name);
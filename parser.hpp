@@ -1,12 +1,24 @@
 #ifndef PARSER_HPP
 #define PARSER_HPP
 
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "simulation.hpp"
+
 /*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
 
 void parser_init(const char *name);
 
+// loads the file given to parser_init into the default context
 void parser_load_pattern();
 
+// loads pattern file 'name' into 'context'; the colormap is not part of a context, see parser_load_colormap
+void parser_load_pattern(SimulationContext& context, const char *name);
+
+// same as above with 'seed' from the start and in place of the seed of every 'use seed' in the file, so that the
+// context is set up exactly as from a copy of the file with all its seeds replaced by 'seed'
+void parser_load_pattern(SimulationContext& context, const char *name, int seed);
+
 void parser_load_colormap();
 
 #endif // PARSER_HPP
@@ -19,21 +19,17 @@
 #include "export.hpp"
 #include "nns_base.hpp"
 #include "parser.hpp"
+#include "render.hpp"
 #include "simulation.hpp"
 #include "types.hpp"
+#include "video.hpp"
 
 /*-------------------------------- IMPORTED VARIABLES --------------------------------*/
 
-extern NNS *nns;
-extern Simulation simulation;
-extern Statistics statistics;
+// nns, simulation and statistics are declared in simulation.hpp
 
 //extern float time_draw;
 
-/*-------------------------------- LOCAL TYPES --------------------------------*/
-
-enum CellExhibition {OCTOGON = 0, SQUARE, HEXAGON_INSIDE, HEXAGON_OUTSIDE, CIRCLE};
-
 /*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
 
 void graphics_done();
@@ -68,7 +64,9 @@ static TwBar *bar = NULL;
 static int    bar_w = 160;
 
 static int out_counter = 0;
-static GLubyte *pixels = NULL;
+
+static VideoWriter video;             // recording of the window, see 'r'
+static int         video_iteration = -1; // of the last recorded frame
 
 /*-------------------------------- LOCAL UTILITY FUNCTIONS --------------------------------*/
 
@@ -93,20 +91,46 @@ static char *concat(const char *s1, const char *s2)
 	return strdup(tmp);
 }
 
+// cells may be renumbered while running, and the simulation keeps track of the picked one
+static void run_steps(int steps)
+{
+	simulation_run(steps);
+	if (picked_cell_id != -1) {
+		picked_cell_id = simulation.tracked_id;
+	}
+}
+
 /*-------------------------------- SCREEN CAPTURE FUNCTIONS --------------------------------*/
 
 void take_snapshot()
 {
 	// NOTE: glReadPixels() often fails after the window has been resized
-    pixels = (GLubyte *) realloc(pixels, window_w * window_h * 3 * sizeof(GLubyte));
-    glReadPixels(0, 0, window_w, window_h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+	std::vector<unsigned char> pixels(window_w * window_h * 3);
+    glReadPixels(0, 0, window_w, window_h, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
 
+	// the file is written in the background, so that recording frames does not stall the display
 	char filename[256];
 	sprintf(filename, "out-%02d.png", out_counter);
-	export_png(filename, window_w, window_h, pixels);
+	export_png_async(filename, window_w, window_h, pixels);
 	out_counter++;
 }
 
+// appends the window to the video once per iteration, at the size it had when recording started
+void record_frame()
+{
+	if (!video.is_open() || video_iteration == simulation.iteration) {
+		return;
+	}
+	std::vector<unsigned char> pixels(video.get_width() * video.get_height() * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, video.get_width(), video.get_height(), GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+	if (!video.write(&pixels[0])) {
+		std::cout << "gui: cannot write movie.y4m, recording stopped\n";
+		video.close();
+	}
+	video_iteration = simulation.iteration;
+}
+
 /*-------------------------------- GRAPHICS FUNCTIONS --------------------------------*/
 
 void display()
@@ -133,20 +157,19 @@ void display()
 
     // draw cells
 	for (int i = 0; i < simulation.n_cells; i++) {
-		Cell& curr_cell = simulation.curr_cells[i];
-		float x = curr_cell.x;
-		float y = curr_cell.y;
+		float x = simulation.curr_cells.x[i];
+		float y = simulation.curr_cells.y[i];
 #ifndef NNS_PRECISION
-		glColor3fv(colormap_lookup(curr_cell.conc[value_active]));
+		glColor3fv(colormap_lookup(simulation.curr_cells.conc[value_active][i]));
 #else
-		glColor3fv(colormap_lookup(curr_cell.error));
+		glColor3fv(colormap_lookup(simulation.curr_cells.error[i]));
 #endif // NNS_PRECISION
 
 //		if (vector) {
 //			vector_draw_cell(x, y, r);
 //		}
 
-		if (show_neighbors && (curr_cell.marker == true)) {
+		if (show_neighbors && (simulation.curr_cells.marker[i] == true)) {
 			glColor3f(1, 1, 1);
 		}
 
@@ -220,8 +243,8 @@ void display()
 			if (picked_cell_id == first || picked_cell_id == second) {
 				glColor3f(1, 1, 1);
 			}
-			glVertex2f(simulation.curr_cells[first].x, simulation.curr_cells[first].y);
-			glVertex2f(simulation.curr_cells[second].x, simulation.curr_cells[second].y);
+			glVertex2f(simulation.curr_cells.x[first], simulation.curr_cells.y[first]);
+			glVertex2f(simulation.curr_cells.x[second], simulation.curr_cells.y[second]);
 			if (picked_cell_id == first || picked_cell_id == second) {
 				glColor3f(1, 0, 0);
 			}
@@ -234,18 +257,17 @@ void display()
 		glColor3f(0, 0, 0);
 		glBegin(GL_LINES);
 		for (int i = 0; i < simulation.n_cells; i++) {
-			glVertex2f(simulation.curr_cells[i].x, simulation.curr_cells[i].y);
-			glVertex2f(simulation.curr_cells[i].x + simulation.curr_cells[i].polarity_x,
-					   simulation.curr_cells[i].y + simulation.curr_cells[i].polarity_y);
+			glVertex2f(simulation.curr_cells.x[i], simulation.curr_cells.y[i]);
+			glVertex2f(simulation.curr_cells.x[i] + simulation.curr_cells.polarity_x[i],
+					   simulation.curr_cells.y[i] + simulation.curr_cells.polarity_y[i]);
 		}
 		glEnd();
 	}
 
     // draw influence range for selected cell
     if (picked_cell_id != -1) {
-    	Cell& picked_cell = simulation.curr_cells[picked_cell_id];
-    	float x = picked_cell.x;
-    	float y = picked_cell.y;
+    	float x = simulation.curr_cells.x[picked_cell_id];
+    	float y = simulation.curr_cells.y[picked_cell_id];
     	glColor3f(1, 1, 1);
 
     	// draw an octagonal outline
@@ -275,6 +297,7 @@ void display()
     // draw tweak bar
     TwDraw();
 
+    record_frame();
     glutSwapBuffers();
 
 //	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t1);
@@ -369,12 +392,12 @@ void idle()
 			}
 			else {
 				//std::cout << "run " << simulation.snap_at[0] - simulation.iteration << " steps\n";
-				simulation_run(simulation.snap_at[0] - simulation.iteration);
+				run_steps(simulation.snap_at[0] - simulation.iteration);
 			}
 		}
 		else {
 			// jump to next iteration that is multiple of 100
-			simulation_run(100 - simulation.iteration % 100);
+			run_steps(100 - simulation.iteration % 100);
 		}
 	}
 	TwRefreshBar(bar);
@@ -391,13 +414,13 @@ void keyboard(unsigned char key, int x, int y)
     switch (key) {
         case ' ': // SPACE - run single step
             simulation.is_running = false;
-            simulation_run(1);
+            run_steps(1);
             TwRefreshBar(bar);
             glutPostRedisplay();
             break;
         case 9: // TAB - run to multiple of 50 steps
             simulation.is_running = false;
-            simulation_run(50 - simulation.iteration % 50);
+            run_steps(50 - simulation.iteration % 50);
             TwRefreshBar(bar);
             glutPostRedisplay();
             break;
@@ -464,6 +487,20 @@ void keyboard(unsigned char key, int x, int y)
         	show_polarity ^= 1;
             glutPostRedisplay();
             break;
+        case 'r': // start/stop recording the window to a video
+        	if (video.is_open()) {
+        		std::cout << "gui: " << video.get_frame_count() << " frames recorded\n";
+        		video.close();
+        	}
+        	else if (video.open("movie.y4m", window_w, window_h)) {
+        		std::cout << "gui: recording " << window_w << " by " << window_h << " frames to movie.y4m\n";
+        		video_iteration = -1;
+        		glutPostRedisplay();
+        	}
+        	else {
+        		std::cout << "gui: cannot write movie.y4m\n";
+        	}
+            break;
         case 's': // start/stop
             simulation.is_running = ! simulation.is_running;
             TwRefreshBar(bar);
@@ -473,6 +510,11 @@ void keyboard(unsigned char key, int x, int y)
         	export_texture(value_active, simulation.texture_width, simulation.texture_height);
         	std::cout << "gui: ... done\n";
             break;
+        case 'T': // output textures of all chemicals at once
+        	std::cout << "gui: saving " << simulation.texture_width << " by " << simulation.texture_height << " textures of " << simulation.n_chemicals << " chemicals...\n";
+        	export_textures(simulation.texture_width, simulation.texture_height);
+        	std::cout << "gui: ... done\n";
+            break;
 //        case 'w': // output high-quality interpolated wrapped texture
 //        	std::cout << "gui: saving " << simulation.texture_width << " by " << simulation.texture_height << " wrapped texture...\n";
 //        	export_texture_wrap(value_active, simulation.texture_width, simulation.texture_height, 64, 64);
@@ -526,8 +568,8 @@ void mouse_click(int button, int state, int x, int y)
         picked_point = unproject(x, y);
     	//std::cout << "picked at " << x << "," << y << " corresponds to " << picked_point.x << "," << picked_point.y << '\n';
         CellId id = nns->locate_nearest(picked_point.x, picked_point.y);
-        float x = simulation.curr_cells[id].x;
-        float y = simulation.curr_cells[id].y;
+        float x = simulation.curr_cells.x[id];
+        float y = simulation.curr_cells.y[id];
     	if ((picked_point.x - x) * (picked_point.x - x) + (picked_point.y - y) * (picked_point.y - y) <= 1) {
     		//std::cout << "picked cell at " << x << "," << y << " id=" << id << '\n';
     		picked_cell_id = id;
@@ -576,8 +618,8 @@ void mouse_motion(int x, int y)
         glutSetCursor(GLUT_CURSOR_LEFT_RIGHT);
     	picked_point = unproject(x, y);
     	if (picked_cell_id != -1) {
-    		simulation.curr_cells[picked_cell_id].x = picked_point.x;
-    		simulation.curr_cells[picked_cell_id].y = picked_point.y;
+    		simulation.curr_cells.x[picked_cell_id] = picked_point.x;
+    		simulation.curr_cells.y[picked_cell_id] = picked_point.y;
     	    nns->update_position(picked_cell_id, picked_point.x, picked_point.y);
     	}
         glutPostRedisplay();
@@ -623,6 +665,7 @@ void TW_CALL set_cell_state(const void *value, void *client_data)
 		const int id = *(static_cast<const int *> (value));
 		if (id >= 0 && id < simulation.n_cells) {
 			picked_cell_id = id;
+			simulation.tracked_id = picked_cell_id;
 		}
 		return;
 	}
@@ -634,7 +677,7 @@ void TW_CALL set_cell_state(const void *value, void *client_data)
 
 	if (attrib == CELL_BIRTH) {
 		const int val = *(static_cast<const int *> (value));
-		simulation.curr_cells[picked_cell_id].birth = val;
+		simulation.curr_cells.birth[picked_cell_id] = val;
 		return;
 	}
 
@@ -647,26 +690,26 @@ void TW_CALL set_cell_state(const void *value, void *client_data)
 	}
 	const float val = *(static_cast<const float *> (value));
 	if (attrib == CELL_X) {
-		simulation.curr_cells[picked_cell_id].x = val;
-	    nns->update_position(picked_cell_id, val, simulation.curr_cells[picked_cell_id].y);
+		simulation.curr_cells.x[picked_cell_id] = val;
+	    nns->update_position(picked_cell_id, val, simulation.curr_cells.y[picked_cell_id]);
 	}
 	else if (attrib == CELL_Y) {
-		simulation.curr_cells[picked_cell_id].y = val;
-	    nns->update_position(picked_cell_id, simulation.curr_cells[picked_cell_id].x, val);
+		simulation.curr_cells.y[picked_cell_id] = val;
+	    nns->update_position(picked_cell_id, simulation.curr_cells.x[picked_cell_id], val);
 	}
 	else if (attrib == CELL_PX) {
-		simulation.curr_cells[picked_cell_id].polarity_x = val;
+		simulation.curr_cells.polarity_x[picked_cell_id] = val;
 	}
 	else if (attrib == CELL_PY) {
-		simulation.curr_cells[picked_cell_id].polarity_y = val;
+		simulation.curr_cells.polarity_y[picked_cell_id] = val;
 	}
 	else if (attrib >= CONC_0 && attrib <= CONC_9) {
 		int i = attrib - CONC_0;
-		simulation.curr_cells[picked_cell_id].conc[i] = val;
+		simulation.curr_cells.conc[i][picked_cell_id] = val;
 	}
 	else if (attrib >= DIFF_0 && attrib <= DIFF_9) {
 		int i = attrib - DIFF_0;
-		simulation.curr_cells[picked_cell_id].diff[i] = val;
+		simulation.curr_cells.diff[i][picked_cell_id] = val;
 	}
 }
 
@@ -685,43 +728,43 @@ void TW_CALL get_cell_state(void *value, void *client_data)
 	}
 
 	if (attrib == CELL_BIRTH) {
-		int val = simulation.curr_cells[picked_cell_id].birth;
+		int val = simulation.curr_cells.birth[picked_cell_id];
 		*(static_cast<int *> (value)) = val;
 		return;
 	}
 
 	if (attrib == CELL_AGE) {
-		int val = simulation.iteration - simulation.curr_cells[picked_cell_id].birth;
+		int val = simulation.iteration - simulation.curr_cells.birth[picked_cell_id];
 		*(static_cast<int *> (value)) = val;
 		return;
 	}
 
 	if (attrib == CELL_NEIG) {
-		int val = simulation.curr_cells[picked_cell_id].neighbors;
+		int val = simulation.curr_cells.neighbors[picked_cell_id];
 		*(static_cast<int *> (value)) = val;
 		return;
 	}
 
 	float val = 0;
 	if (attrib == CELL_X) {
-		val = simulation.curr_cells[picked_cell_id].x;
+		val = simulation.curr_cells.x[picked_cell_id];
 	}
 	else if (attrib == CELL_Y) {
-		val = simulation.curr_cells[picked_cell_id].y;
+		val = simulation.curr_cells.y[picked_cell_id];
 	}
 	else if (attrib == CELL_PX) {
-		val = simulation.curr_cells[picked_cell_id].polarity_x;
+		val = simulation.curr_cells.polarity_x[picked_cell_id];
 	}
 	else if (attrib == CELL_PY) {
-		val = simulation.curr_cells[picked_cell_id].polarity_y;
+		val = simulation.curr_cells.polarity_y[picked_cell_id];
 	}
 	else if (attrib >= CONC_0 && attrib <= CONC_9) {
 		int i = attrib - CONC_0;
-		val = simulation.curr_cells[picked_cell_id].conc[i];
+		val = simulation.curr_cells.conc[i][picked_cell_id];
 	}
 	else if (attrib >= DIFF_0 && attrib <= DIFF_9) {
 		int i = attrib - DIFF_0;
-		val = simulation.curr_cells[picked_cell_id].diff[i];
+		val = simulation.curr_cells.diff[i][picked_cell_id];
 	}
 	*(static_cast<float *> (value)) = val;
 }
@@ -874,7 +917,8 @@ void graphics_loop()
 void graphics_done()
 {
 	TwTerminate();
-	free(pixels);
+	video.close();
+	export_stop_encoders();
 }
 
 int main(int argc, char *argv[])
@@ -883,7 +927,9 @@ int main(int argc, char *argv[])
     	std::cout << "usage: pattern [OPTION] ... FILE.pat\n";
     	std::cout << "  --ss         force use of spatial sorting\n";
     	std::cout << "  --kd         force use of k-d tree\n";
+    	std::cout << "  --grid       force use of cell list\n";
     	std::cout << "  --detect     exit as soon as stability is detected\n";
+    	std::cout << "  --reorder    renumber cells by position as the tissue grows\n";
     	std::cout << "  --oct        draw each cell as an octogon (default)\n";
     	std::cout << "  --sqr        draw each cell as a square\n";
     	std::cout << "  --hex_in     draw each cell as an inscribed hexagon\n";
@@ -895,6 +941,7 @@ int main(int argc, char *argv[])
     argv++; argc--;
 
     bool detect = false;
+    bool reorder = false;
     NNSChoice nns_choice = AUTO;
     while ((*argv)[0] == '-') {
     	if (strcmp(*argv, "--ss") == 0) {
@@ -903,9 +950,15 @@ int main(int argc, char *argv[])
     	else if (strcmp(*argv, "--kd") == 0) {
     		nns_choice = KD_TREE;
     	}
+    	else if (strcmp(*argv, "--grid") == 0) {
+    		nns_choice = CELL_LIST;
+    	}
     	else if (strcmp(*argv, "--detect") == 0) {
     		detect = true;;
     	}
+    	else if (strcmp(*argv, "--reorder") == 0) {
+    		reorder = true;
+    	}
     	else if (strcmp(*argv, "--oct") == 0) {
     		cell_ex = OCTOGON;
     	}
@@ -935,7 +988,8 @@ int main(int argc, char *argv[])
 	parser_load_colormap();
 	colormap_generate();
 
-	simulation_init(nns_choice, detect);
+	simulation_init(nns_choice, detect, 1, CACHE_AUTO, 1, reorder);
+	export_start_encoders(1);
 
     graphics_init(&argc, argv);
     graphics_loop(); // never returns
@@ -0,0 +1,156 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <time.h>
+
+#include <cstdio>
+
+#include "profiler.hpp"
+
+/*-------------------------------- LOCAL VARIABLES --------------------------------*/
+
+static const char *phase_names[N_PHASES] = {
+	"nns setup",
+	"reactions",
+	"cells",
+	"  evaluate",
+	"  neighbors",
+	"  interact",
+	"  clamp",
+	"neighbor lists",
+	"divisions",
+	"mirroring",
+	"stability",
+	"nns update",
+	"reorder"
+};
+
+static const char *phase_keys[N_PHASES] = {
+	"nns_setup",
+	"reactions",
+	"cells",
+	"evaluate",
+	"neighbors",
+	"interact",
+	"clamp",
+	"neighbor_lists",
+	"divisions",
+	"mirroring",
+	"stability",
+	"nns_update",
+	"reorder"
+};
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+static bool is_thread_phase(int phase)
+{
+	return phase >= PHASE_EVALUATE && phase <= PHASE_CLAMP;
+}
+
+/*-------------------------------- STOPWATCH --------------------------------*/
+
+Stopwatch::Stopwatch(bool enabled, double *times)
+{
+	this->enabled = enabled;
+	this->times = times;
+	last = enabled ? Profiler::now() : 0;
+}
+
+void Stopwatch::lap(Phase phase)
+{
+	if (enabled) {
+		double t = Profiler::now();
+		times[phase] += t - last;
+		last = t;
+	}
+}
+
+/*-------------------------------- PROFILER --------------------------------*/
+
+Profiler::Profiler()
+{
+	enabled = false;
+	for (int p = 0; p < N_PHASES; p++) {
+		current[p] = total[p] = max[p] = 0;
+	}
+	step_start = step_total = step_max = 0;
+	iterations = 0;
+}
+
+double Profiler::now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000.0 + t.tv_nsec * 0.000001;
+}
+
+const char *Profiler::get_phase_key(int phase)
+{
+	return phase_keys[phase];
+}
+
+void Profiler::start_iteration()
+{
+	for (int p = 0; p < N_PHASES; p++) {
+		current[p] = 0;
+	}
+	step_start = now();
+}
+
+void Profiler::finish_iteration()
+{
+	double step = now() - step_start;
+	step_total += step;
+	if (step > step_max) {
+		step_max = step;
+	}
+	for (int p = 0; p < N_PHASES; p++) {
+		total[p] += current[p];
+		if (current[p] > max[p]) {
+			max[p] = current[p];
+		}
+	}
+	iterations++;
+}
+
+void Profiler::report(std::ostream& out, ProfileFormat format, int n_cells, int n_threads) const
+{
+	char line[200];
+	int n = (iterations > 0) ? iterations : 1;
+
+	// wall time not covered by any phase, e.g. rule selection; thread phases are part of PHASE_CELLS
+	double other = step_total;
+	for (int p = 0; p < N_PHASES; p++) {
+		if (!is_thread_phase(p)) {
+			other -= total[p];
+		}
+	}
+
+	if (format == PROFILE_JSON) {
+		out << "{\"iterations\": " << iterations << ", \"cells\": " << n_cells << ", \"threads\": " << n_threads << ", \"phases\": [";
+		for (int p = 0; p < N_PHASES; p++) {
+			snprintf(line, sizeof(line), "%s{\"name\": \"%s\", \"total_ms\": %.3f, \"mean_ms\": %.4f, \"max_ms\": %.4f, \"thread_time\": %s}",
+					(p > 0) ? ", " : "", phase_keys[p], total[p], total[p] / n, max[p], is_thread_phase(p) ? "true" : "false");
+			out << line;
+		}
+		snprintf(line, sizeof(line), "], \"other_ms\": %.3f, \"step\": {\"total_ms\": %.3f, \"mean_ms\": %.4f, \"max_ms\": %.4f}}\n",
+				other, step_total, step_total / n, step_max);
+		out << line;
+		return;
+	}
+
+	out << "profile: " << iterations << " iterations, " << n_cells << " cells, " << n_threads << " threads\n";
+	snprintf(line, sizeof(line), "%-16s %12s %10s %10s %7s\n", "phase", "total ms", "ms/iter", "max ms", "%");
+	out << line;
+	for (int p = 0; p < N_PHASES; p++) {
+		snprintf(line, sizeof(line), "%-16s %12.1f %10.3f %10.3f %6.1f%s\n", phase_names[p], total[p], total[p] / n, max[p],
+				(step_total > 0) ? 100 * total[p] / step_total : 0.0, is_thread_phase(p) ? " *" : "");
+		out << line;
+	}
+	snprintf(line, sizeof(line), "%-16s %12.1f %10.3f\n", "other", other, other / n);
+	out << line;
+	snprintf(line, sizeof(line), "%-16s %12.1f %10.3f %10.3f  %.1f iter/s\n", "step", step_total, step_total / n, step_max,
+			(step_total > 0) ? 1000 * iterations / step_total : 0.0);
+	out << line;
+	out << "* time summed over threads, split among phases from a sample of the cells\n";
+}
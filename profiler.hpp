@@ -0,0 +1,77 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <ostream>
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+// phases of a simulation step; the per-cell phases (evaluate to clamp) run on all threads, so their times are summed
+// over threads, while the others are wall-clock times
+enum Phase {
+	PHASE_NNS_SETUP = 0,
+	PHASE_REACTIONS,
+	PHASE_CELLS,
+	PHASE_EVALUATE,
+	PHASE_NEIGHBORS,
+	PHASE_INTERACT,
+	PHASE_CLAMP,
+	PHASE_NEIGHBOR_LISTS,
+	PHASE_DIVISIONS,
+	PHASE_MIRRORING,
+	PHASE_STABILITY,
+	PHASE_NNS_UPDATE,
+	PHASE_REORDER,
+	N_PHASES
+};
+
+enum ProfileFormat {PROFILE_TABLE, PROFILE_JSON};
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// times of consecutive phases, added to 'times' (in ms) on each lap; costs nothing when not enabled
+class Stopwatch {
+private:
+	bool    enabled;
+	double *times;
+	double  last;
+
+public:
+	Stopwatch(bool enabled, double *times);
+
+	void lap(Phase phase);
+};
+
+// cumulative and per-iteration times of each phase
+class Profiler {
+public:
+	bool   enabled;
+	double current[N_PHASES]; // times of the iteration in progress
+
+private:
+	double total[N_PHASES];
+	double max[N_PHASES];
+	double step_start, step_total, step_max;
+	int    iterations;
+
+public:
+	Profiler();
+
+	// current time in ms, from a monotonic clock
+	static double now();
+
+	void start_iteration();
+	void finish_iteration();
+
+	double get_total(int phase) const { return total[phase]; }
+	double get_step_total() const { return step_total; }
+	int    get_iterations() const { return iterations; }
+
+	// short name of a phase, as used in JSON and CSV output
+	static const char *get_phase_key(int phase);
+
+	void report(std::ostream& out, ProfileFormat format, int n_cells, int n_threads) const;
+};
+
+#endif // PROFILER_HPP
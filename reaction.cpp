@@ -0,0 +1,145 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <algorithm>
+#include <cassert>
+
+#include "reaction.hpp"
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+// values of one operand for all cells: a constant has stride 0
+struct Operand {
+	const float *values;
+	int          stride;
+};
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+static Operand get_operand(const Program& program, const CellArray& curr, int reg)
+{
+	Operand op;
+	if (reg < MAX_CHEMICALS) {
+		op.values = curr.conc[reg];
+		op.stride = 1;
+	}
+	else if (reg < 2 * MAX_CHEMICALS) {
+		op.values = curr.diff[reg - MAX_CHEMICALS];
+		op.stride = 1;
+	}
+	else {
+		op.values = &program.constants[reg - REG_CONSTANTS];
+		op.stride = 0;
+	}
+	return op;
+}
+
+// one reaction over cells [begin, end); with CONSTANT all parameters are loaded once, otherwise they are read per cell
+// NOTE: the loops are marked for vectorization (see -fopenmp-simd in Makefile), as curr and next never overlap
+
+template <Action ACTION, bool CONSTANT>
+static void react(const Program& program, const Instruction& in, const CellArray& curr, CellArray& next, float dt, int begin, int end)
+{
+	const float *__restrict u_curr = curr.conc[in.op[0]];
+	const float *__restrict v_curr = curr.conc[(ACTION == REACT_GS || ACTION == REACT_TU) ? in.op[1] : in.op[0]];
+	float *__restrict u_next = next.conc[in.op[0]];
+	float *__restrict v_next = next.conc[(ACTION == REACT_GS || ACTION == REACT_TU) ? in.op[1] : in.op[0]];
+
+	// both are written only by gray-scott and turing, whose rules naming the same chemical twice are left to the rule
+	// loop by Program::is_tissue_reaction
+	assert(!(ACTION == REACT_GS || ACTION == REACT_TU) || u_next != v_next);
+
+	Operand p[4];
+	for (int i = 0; i < 4; i++) {
+		p[i] = get_operand(program, curr, in.op[i + 2]);
+	}
+
+	if (CONSTANT) {
+		const float s = p[0].values[0], a = p[1].values[0], b = p[2].values[0], c = p[3].values[0];
+
+		#pragma omp simd
+		for (int id = begin; id < end; id++) {
+			float u = u_curr[id];
+			float v = v_curr[id];
+			switch (ACTION) {
+			case REACT_GS:
+				u_next[id] += s * (-u * v * v + a * (1 - u)) * dt;
+				v_next[id] += s * ( u * v * v - (a + b) * v) * dt;
+				break;
+			case REACT_TU:
+				u_next[id] += s * (a - u * v)    * dt;
+				v_next[id] += s * (u * v - v - b) * dt;
+				break;
+			case REACT_LI:
+				u_next[id] += s * (a * u - b) * dt;
+				break;
+			case REACT_CU:
+				u_next[id] += s * (u - a) * (u - b) * (u - c) * dt;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	else {
+		const float *__restrict ps = p[0].values, *__restrict pa = p[1].values, *__restrict pb = p[2].values, *__restrict pc = p[3].values;
+		const int ss = p[0].stride, sa = p[1].stride, sb = p[2].stride, sc = p[3].stride;
+
+		#pragma omp simd
+		for (int id = begin; id < end; id++) {
+			float u = u_curr[id];
+			float v = v_curr[id];
+			float s = ps[id * ss], a = pa[id * sa], b = pb[id * sb], c = pc[id * sc];
+			switch (ACTION) {
+			case REACT_GS:
+				u_next[id] += s * (-u * v * v + a * (1 - u)) * dt;
+				v_next[id] += s * ( u * v * v - (a + b) * v) * dt;
+				break;
+			case REACT_TU:
+				u_next[id] += s * (a - u * v)    * dt;
+				v_next[id] += s * (u * v - v - b) * dt;
+				break;
+			case REACT_LI:
+				u_next[id] += s * (a * u - b) * dt;
+				break;
+			case REACT_CU:
+				u_next[id] += s * (u - a) * (u - b) * (u - c) * dt;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+template <Action ACTION>
+static void react(const Program& program, const Instruction& in, const CellArray& curr, CellArray& next, float dt, int begin, int end)
+{
+	if (in.constant) {
+		react<ACTION, true>(program, in, curr, next, dt, begin, end);
+	}
+	else {
+		react<ACTION, false>(program, in, curr, next, dt, begin, end);
+	}
+}
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+void reaction_run(const Program& program, const CellArray& curr, CellArray& next, float dt, int begin, int end)
+{
+	// reactions add to current concentrations, as the rule loop does
+	for (int i = 0; i < (int) program.reacted.size(); i++) {
+		int ch = program.reacted[i];
+		std::copy(curr.conc[ch] + begin, curr.conc[ch] + end, next.conc[ch] + begin);
+	}
+
+	for (int i = 0; i < (int) program.reactions.size(); i++) {
+		const Instruction& in = program.reactions[i];
+		switch (in.action) {
+		case REACT_GS: react<REACT_GS>(program, in, curr, next, dt, begin, end); break;
+		case REACT_TU: react<REACT_TU>(program, in, curr, next, dt, begin, end); break;
+		case REACT_LI: react<REACT_LI>(program, in, curr, next, dt, begin, end); break;
+		case REACT_CU: react<REACT_CU>(program, in, curr, next, dt, begin, end); break;
+		default: break;
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef REACTION_HPP
+#define REACTION_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "compiler.hpp"
+#include "types.hpp"
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+// apply the whole-tissue reactions of 'program' to cells [begin, end): concentrations of reacted chemicals in 'next'
+// are set to those in 'curr' plus the reaction terms
+void reaction_run(const Program& program, const CellArray& curr, CellArray& next, float dt, int begin, int end);
+
+#endif // REACTION_HPP
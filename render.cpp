@@ -0,0 +1,202 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "colormap.hpp"
+#include "workers.hpp"
+
+#include "render.hpp"
+
+/*-------------------------------- MACRO DEFINITIONS --------------------------------*/
+
+#define TILE_SIZE    64 // pixels on each side
+#define MAX_VERTICES 18
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+// cells of each tile, in drawing order, and what is needed to draw them
+struct RenderTask {
+	const Simulation *simulation;
+	const float *values;
+	float value_min, value_max;
+	int   n_vertices;
+	float shape_x[MAX_VERTICES], shape_y[MAX_VERTICES]; // counterclockwise, in pixels
+	float scale;  // pixels per unit
+	float xmin, ymin; // of the image, in units
+	int   width, height;
+	int   tiles_x, tiles_y;
+	std::vector<std::vector<int> > tiles;
+	unsigned char *pixels;
+};
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+// same polygons as the GUI draws
+static int get_shape(CellExhibition shape, float *x, float *y)
+{
+	static const float octogon_x[] = {1, 0.7071, 0, -0.7071, -1, -0.7071, 0, 0.7071};
+	static const float octogon_y[] = {0, 0.7071, 1, 0.7071, 0, -0.7071, -1, -0.7071};
+	static const float square_x[] = {1, -1, -1, 1};
+	static const float square_y[] = {1, 1, -1, -1};
+	static const float hexagon_inside_x[] = {0, 0.866, 0.866, 0, -0.866, -0.866};
+	static const float hexagon_inside_y[] = {-1, -0.5, 0.5, 1, 0.5, -0.5};
+	static const float hexagon_outside_x[] = {0, 1, 1, 0, -1, -1};
+	static const float hexagon_outside_y[] = {-1.1547, -0.577, 0.577, 1.1547, 0.577, -0.577};
+
+	int n = 0;
+	if (shape == OCTOGON) {
+		n = 8;
+		memcpy(x, octogon_x, sizeof(octogon_x));
+		memcpy(y, octogon_y, sizeof(octogon_y));
+	}
+	else if (shape == SQUARE) {
+		n = 4;
+		memcpy(x, square_x, sizeof(square_x));
+		memcpy(y, square_y, sizeof(square_y));
+	}
+	else if (shape == HEXAGON_INSIDE) {
+		n = 6;
+		memcpy(x, hexagon_inside_x, sizeof(hexagon_inside_x));
+		memcpy(y, hexagon_inside_y, sizeof(hexagon_inside_y));
+	}
+	else if (shape == HEXAGON_OUTSIDE) {
+		n = 6;
+		memcpy(x, hexagon_outside_x, sizeof(hexagon_outside_x));
+		memcpy(y, hexagon_outside_y, sizeof(hexagon_outside_y));
+	}
+	else {
+		n = 18;
+		for (int a = 0; a < n; a++) {
+			x[a] = cosf(M_PI * a / 9);
+			y[a] = sinf(M_PI * a / 9);
+		}
+	}
+	return n;
+}
+
+// fills the pixels of the tile whose centers are inside the polygon of each of its cells
+static void draw_tile(const RenderTask& task, int tile)
+{
+	const CellArray& cells = task.simulation->curr_cells;
+	int c_begin = (tile % task.tiles_x) * TILE_SIZE;
+	int r_begin = (tile / task.tiles_x) * TILE_SIZE;
+	int c_end = std::min(task.width, c_begin + TILE_SIZE);
+	int r_end = std::min(task.height, r_begin + TILE_SIZE);
+
+	const std::vector<int>& ids = task.tiles[tile];
+	for (int i = 0; i < (int) ids.size(); i++) {
+		int id = ids[i];
+		float cx = (cells.x[id] - task.xmin) * task.scale;
+		float cy = (cells.y[id] - task.ymin) * task.scale;
+
+		float vx[MAX_VERTICES], vy[MAX_VERTICES];
+		float xmin = cx, xmax = cx, ymin = cy, ymax = cy;
+		for (int k = 0; k < task.n_vertices; k++) {
+			vx[k] = cx + task.shape_x[k];
+			vy[k] = cy + task.shape_y[k];
+			xmin = std::min(xmin, vx[k]); xmax = std::max(xmax, vx[k]);
+			ymin = std::min(ymin, vy[k]); ymax = std::max(ymax, vy[k]);
+		}
+		int c0 = std::max(c_begin, (int) ceilf(xmin - 0.5f)), c1 = std::min(c_end - 1, (int) floorf(xmax - 0.5f));
+		int r0 = std::max(r_begin, (int) ceilf(ymin - 0.5f)), r1 = std::min(r_end - 1, (int) floorf(ymax - 0.5f));
+		if (c0 > c1 || r0 > r1) {
+			continue;
+		}
+
+		float *rgb = colormap_lookup(task.values[id], task.value_min, task.value_max);
+		unsigned char color[3];
+		for (int k = 0; k < 3; k++) {
+			color[k] = (unsigned char) (rgb[k] * 255 + 0.5f);
+		}
+
+		for (int r = r0; r <= r1; r++) {
+			float py = r + 0.5f;
+			for (int c = c0; c <= c1; c++) {
+				float px = c + 0.5f;
+				bool inside = true;
+				for (int k = 0, j = task.n_vertices - 1; k < task.n_vertices && inside; j = k++) {
+					inside = ((vx[k] - vx[j]) * (py - vy[j]) - (vy[k] - vy[j]) * (px - vx[j]) >= 0);
+				}
+				if (inside) {
+					memcpy(&task.pixels[(r * task.width + c) * 3], color, 3);
+				}
+			}
+		}
+	}
+}
+
+// each thread takes a range of tiles; tiles do not overlap, so no pixel is written by two threads
+static void draw_tiles(int thread, int n_threads, void *data)
+{
+	const RenderTask& task = *(const RenderTask*) data;
+	int tile_begin, tile_end;
+	WorkerPool::split(task.tiles_x * task.tiles_y, thread, n_threads, tile_begin, tile_end);
+	for (int tile = tile_begin; tile < tile_end; tile++) {
+		draw_tile(task, tile);
+	}
+}
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+void render_cells(const SimulationContext& context, int chemical, CellExhibition shape, int width, int height, unsigned char *pixels)
+{
+	const Simulation& simulation = context.simulation;
+	const Statistics& statistics = context.statistics;
+
+	RenderTask task;
+	task.simulation = &simulation;
+	task.values = simulation.curr_cells.conc[chemical];
+	task.value_min = statistics.chem_min[chemical];
+	task.value_max = statistics.chem_max[chemical];
+	task.width = width;
+	task.height = height;
+	task.pixels = pixels;
+
+	// centered on the tissue, which spans the shorter side with a cell radius to spare on each end
+	if (width > height) {
+		task.scale = height / (statistics.cell_ymax - statistics.cell_ymin + 2);
+	}
+	else {
+		task.scale = width / (statistics.cell_xmax - statistics.cell_xmin + 2);
+	}
+	task.xmin = (statistics.cell_xmax + statistics.cell_xmin) / 2 - width / 2 / task.scale;
+	task.ymin = (statistics.cell_ymax + statistics.cell_ymin) / 2 - height / 2 / task.scale;
+
+	task.n_vertices = get_shape(shape, task.shape_x, task.shape_y);
+	float radius = 0;
+	for (int k = 0; k < task.n_vertices; k++) {
+		task.shape_x[k] *= task.scale;
+		task.shape_y[k] *= task.scale;
+		radius = std::max(radius, std::max(fabsf(task.shape_x[k]), fabsf(task.shape_y[k])));
+	}
+
+	// cells are sorted into the tiles they may cover, keeping their order
+	task.tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	task.tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	task.tiles.resize(task.tiles_x * task.tiles_y);
+	for (int id = 0; id < simulation.n_cells; id++) {
+		float cx = (simulation.curr_cells.x[id] - task.xmin) * task.scale;
+		float cy = (simulation.curr_cells.y[id] - task.ymin) * task.scale;
+		int tx0 = std::max(0, (int) floorf((cx - radius) / TILE_SIZE));
+		int tx1 = std::min(task.tiles_x - 1, (int) floorf((cx + radius) / TILE_SIZE));
+		int ty0 = std::max(0, (int) floorf((cy - radius) / TILE_SIZE));
+		int ty1 = std::min(task.tiles_y - 1, (int) floorf((cy + radius) / TILE_SIZE));
+		for (int ty = ty0; ty <= ty1; ty++) {
+			for (int tx = tx0; tx <= tx1; tx++) {
+				task.tiles[ty * task.tiles_x + tx].push_back(id);
+			}
+		}
+	}
+
+	// background is black
+	memset(pixels, 0, width * height * 3);
+	if (context.workers) {
+		context.workers->run(draw_tiles, &task);
+	}
+	else {
+		draw_tiles(0, 1, &task);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef RENDER_HPP
+#define RENDER_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include "simulation.hpp"
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+// shape drawn for each cell, of radius 1
+enum CellExhibition {OCTOGON = 0, SQUARE, HEXAGON_INSIDE, HEXAGON_OUTSIDE, CIRCLE};
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+// draws the cells of 'context' colored by 'chemical' into 'pixels' (width * height RGB values, the first row being the
+// bottom of the image, as for export_png), without OpenGL; the view is the one the GUI shows after centering: cells
+// are drawn in order on a black background, and the tissue fills the shorter side of the image
+//
+// the image is cut into tiles that are drawn on the threads of the simulation when it has any
+void render_cells(const SimulationContext& context, int chemical, CellExhibition shape, int width, int height, unsigned char *pixels);
+
+#endif // RENDER_HPP
@@ -4,234 +4,320 @@
 #include <cstdio>
 #include <iomanip>
 
-//#include <time.h>
-
+#include "compiler.hpp"
+#include "diffusion.hpp"
+#include "neighbor_list.hpp"
 #include "nns_base.hpp"
+#include "profiler.hpp"
+#include "reaction.hpp"
 #include "types.hpp"
+#include "workers.hpp"
 
 #include "simulation.hpp"
 
 /*-------------------------------- EXPORTED VARIABLES --------------------------------*/
 
-NNS *nns;
-Simulation simulation;
-Statistics statistics;
-
-//float time_nns_setup, /*time_evaluate, time_nns_query, time_interact,*/ time_calculate, time_total;
-
-/*-------------------------------- LOCAL TYPES --------------------------------*/
-
-struct CellParameters {
-	float polarity;
-	float polarity_dev;
-	float chem_conc[MAX_CHEMICALS];
-	float chem_conc_dev[MAX_CHEMICALS];
-	float chem_diff[MAX_CHEMICALS];
-	float chem_diff_dev[MAX_CHEMICALS];
-
-	CellParameters () {
-		polarity = FLT_MAX; // none
-		polarity_dev = 0;
-		for (int i = 0; i < MAX_CHEMICALS; i++) {
-			chem_conc[i] = 0;
-			chem_conc_dev[i] = 0;
-			chem_diff[i] = 0;
-			chem_diff_dev[i] = 0;
-		}
-	}
-};
+SimulationContext default_context;
+
+NNS *&nns = default_context.nns;
+Simulation& simulation = default_context.simulation;
+Statistics& statistics = default_context.statistics;
+
+/*-------------------------------- MACRO DEFINITIONS --------------------------------*/
+
+// when reordering, locality is checked every REORDER_INTERVAL iterations, and cells are reordered if it got worse
+// than REORDER_FACTOR times what it was after the last reorder
+#define REORDER_INTERVAL 50
+#define REORDER_FACTOR   2.0f
 
-/*-------------------------------- LOCAL VARIABLES --------------------------------*/
+// when profiling, per-cell phases are timed on one cell in PROFILE_SAMPLING, as reading the clock several times for
+// every cell takes longer than the phases themselves; the sampled times only split the time of each thread
+#define PROFILE_SAMPLING 64
 
-static CellParameters cell_parameters;
+/*-------------------------------- CONSTRUCTOR --------------------------------*/
 
-static int nns_dim_x = 0;
-static int nns_dim_y = 0;
-static bool nns_wrap = false;
+SimulationContext::SimulationContext()
+{
+	nns = NULL;
+	log = &std::cout;
+
+	any_anisotropic = false;
+	nns_dim_x = nns_dim_y = 0;
+	nns_wrap = false;
+
+	workers = NULL;
+	neighbor_list = NULL;
+
+	profile_format = PROFILE_TABLE;
+
+	reorder = false;
+	reorder_locality = 0;
 
 #ifdef NNS_PRECISION
-static float error_max = 0;
-static float error_sum = 0;
+	exact = NULL;
+	error_max = error_sum = 0;
 #endif // NNS_PRECISION
+}
 
 /*-------------------------------- RANDOM NUMBER FUNCTIONS --------------------------------*/
 
-static float rand_range(float min, float max)
+void Random::set_seed(unsigned int seed)
 {
-    return min + (max - min) * ((float) rand() / RAND_MAX);
+	// same initialization as srand() of glibc: a minimal standard generator fills the state, and the first outputs
+	// are discarded
+	state[0] = (seed == 0) ? 1 : seed;
+	for (int i = 1; i < 31; i++) {
+		// 16807 * state[i - 1] % 2147483647 without overflow
+		int hi = state[i - 1] / 127773;
+		int lo = state[i - 1] % 127773;
+		int word = 16807 * lo - 2836 * hi;
+		state[i] = (word < 0) ? word + 2147483647 : word;
+	}
+	front = 3;
+	rear = 0;
+	for (int i = 0; i < 310; i++) {
+		next();
+	}
+}
+
+int Random::next()
+{
+	unsigned int value = (unsigned int) state[front] + (unsigned int) state[rear];
+	state[front] = (int) value;
+	front = (front + 1) % 31;
+	rear = (rear + 1) % 31;
+	return (int) (value >> 1);
+}
+
+static float rand_range(float min, float max, Random& random)
+{
+    return min + (max - min) * ((float) random.next() / RAND_MAX);
 }
 
-static float deviate(float value, float deviation)
+static float deviate(float value, float deviation, Random& random)
 {
 	if (deviation == 0) {
 		return value;
 	}
-	return rand_range(value - deviation, value + deviation);
+	return rand_range(value - deviation, value + deviation, random);
+}
+
+// during a simulation step random numbers come from a counter-based generator: each one is a function of the seed,
+// the iteration, the cell id, the rule and what it is drawn for, with no state carried from one draw to the next, so
+// results do not depend on the order cells and rules are evaluated nor on the number of threads
+
+enum Draw {DRAW_CONDITION, DRAW_ACTION};
+
+// Philox4x32-10 of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"; only the first output word is used
+static inline unsigned int philox(unsigned int c0, unsigned int c1, unsigned int c2, unsigned int c3, unsigned int k0, unsigned int k1)
+{
+	for (int round = 0; round < 10; round++) {
+		unsigned long long p0 = 0xD2511F53ull * c0;
+		unsigned long long p1 = 0xCD9E8D57ull * c2;
+		unsigned int x0 = (unsigned int) (p1 >> 32) ^ c1 ^ k0;
+		unsigned int x2 = (unsigned int) (p0 >> 32) ^ c3 ^ k1;
+		c1 = (unsigned int) p1;
+		c3 = (unsigned int) p0;
+		c0 = x0;
+		c2 = x2;
+		k0 += 0x9E3779B9;
+		k1 += 0xBB67AE85;
+	}
+	return c0;
+}
+
+static float rand_range(float min, float max, const Simulation& simulation, CellId id, int rule, Draw draw)
+{
+	unsigned int r = philox((unsigned int) simulation.iteration, (unsigned int) id, (unsigned int) rule, (unsigned int) draw, (unsigned int) simulation.seed, 0);
+	return min + (max - min) * ((r >> 8) * (1.0f / 16777215)); // 24 bits, exact in a float, in [0, 1]
+}
+
+static float deviate(float value, float deviation, const Simulation& simulation, CellId id, int rule, Draw draw)
+{
+	if (deviation == 0) {
+		return value;
+	}
+	return rand_range(value - deviation, value + deviation, simulation, id, rule, draw);
 }
 
 /*-------------------------------- DEFINE FUNCTIONS --------------------------------*/
 
-int simulation_define_chemical(std::string name, float limit, bool anisotropic)
+int simulation_define_chemical(SimulationContext& context, std::string name, float limit, bool anisotropic)
 {
+	Simulation& simulation = context.simulation;
 	int ch = simulation.new_chemical();
 
 	simulation.chemicals[ch].name = name;
 	simulation.chemicals[ch].limit = limit;
 	simulation.chemicals[ch].anisotropic = anisotropic;
+	if (anisotropic) {
+		context.any_anisotropic = true;
+	}
 
 	return ch;
 }
 
-void simulation_define_division_limit(int division_limit)
+void simulation_define_division_limit(SimulationContext& context, int division_limit)
 {
-	simulation.division_limit = division_limit;
+	context.simulation.division_limit = division_limit;
 }
 
-void simulation_define_domain(float width, float height)
+void simulation_define_domain(SimulationContext& context, float width, float height)
 {
+	Simulation& simulation = context.simulation;
 	simulation.domain_xmin = - width  / 2;
 	simulation.domain_xmax =   width  / 2;
 	simulation.domain_ymin = - height / 2;
 	simulation.domain_ymax =   height / 2;
 }
 
-void simulation_define_time_step(float time_step)
+void simulation_define_time_step(SimulationContext& context, float time_step)
 {
-	simulation.time_step = time_step;
+	context.simulation.time_step = time_step;
 }
 
-void simulation_define_mirror_pair(CellId id1, CellId id2)
+void simulation_define_mirror_pair(SimulationContext& context, CellId id1, CellId id2)
 {
+	Simulation& simulation = context.simulation;
 	simulation.mirroring = true;
 	simulation.mirror_list.push_back(std::make_pair(id1, id2));
 }
 
 /*-------------------------------- USE FUNCTIONS --------------------------------*/
 
-void simulation_use_chemical_concentration(int chemical, float value, float deviation)
+void simulation_use_chemical_concentration(SimulationContext& context, int chemical, float value, float deviation)
 {
-	cell_parameters.chem_conc[chemical] = value;
-	cell_parameters.chem_conc_dev[chemical] = deviation;
+	context.cell_parameters.chem_conc[chemical] = value;
+	context.cell_parameters.chem_conc_dev[chemical] = deviation;
 }
 
-void simulation_use_chemical_diffusion(int chemical, float value, float deviation)
+void simulation_use_chemical_diffusion(SimulationContext& context, int chemical, float value, float deviation)
 {
-	cell_parameters.chem_diff[chemical] = value;
-	cell_parameters.chem_diff_dev[chemical] = deviation;
+	context.cell_parameters.chem_diff[chemical] = value;
+	context.cell_parameters.chem_diff_dev[chemical] = deviation;
 }
 
-void simulation_use_polarity(float angle, float deviation)
+void simulation_use_polarity(SimulationContext& context, float angle, float deviation)
 {
-	cell_parameters.polarity = angle;
-	cell_parameters.polarity_dev = deviation;
+	context.cell_parameters.polarity = angle;
+	context.cell_parameters.polarity_dev = deviation;
 }
 
-void simulation_use_seed(int seed)
+void simulation_use_profiler(SimulationContext& context, ProfileFormat format)
+{
+	context.profiler.enabled = true;
+	context.profile_format = format;
+}
+
+void simulation_use_seed(SimulationContext& context, int seed)
 {
+	Simulation& simulation = context.simulation;
 	if (seed == 0) {
-		srand(time(NULL));
-	}
-	else {
-		srand(seed);
+		seed = time(NULL);
 	}
+	context.random.set_seed(seed);
+	simulation.seed = seed;
 }
 
 /*-------------------------------- CREATE FUNCTIONS --------------------------------*/
 
 // NOTE: this function is called only when setting up the simulation, that is, when defining the starting pattern
 
-CellId simulation_create_cell(float x, float y, bool fixed)
+CellId simulation_create_cell(SimulationContext& context, float x, float y, bool fixed)
 {
+	Simulation& simulation = context.simulation;
+	const CellParameters& parameters = context.cell_parameters;
 	CellId id = simulation.new_cell();
 
-	simulation.curr_cells[id].birth = 0;
-	simulation.curr_cells[id].neighbors = 0;
-	simulation.curr_cells[id].x = x;
-	simulation.curr_cells[id].y = y;
-	if (cell_parameters.polarity != FLT_MAX) {
-		float angle = deviate(cell_parameters.polarity, cell_parameters.polarity_dev);
-		simulation.curr_cells[id].polarity_x = cosf(M_PI * angle / 180);
-		simulation.curr_cells[id].polarity_y = sinf(M_PI * angle / 180);
+	simulation.curr_cells.birth[id] = 0;
+	simulation.curr_cells.neighbors[id] = 0;
+	simulation.curr_cells.x[id] = x;
+	simulation.curr_cells.y[id] = y;
+	if (parameters.polarity != FLT_MAX) {
+		float angle = deviate(parameters.polarity, parameters.polarity_dev, context.random);
+		simulation.curr_cells.polarity_x[id] = cosf(M_PI * angle / 180);
+		simulation.curr_cells.polarity_y[id] = sinf(M_PI * angle / 180);
 	}
 	else {
-		simulation.curr_cells[id].polarity_x = simulation.curr_cells[id].polarity_y = 0;
+		simulation.curr_cells.polarity_x[id] = simulation.curr_cells.polarity_y[id] = 0;
 	}
-	for (int i = 0; i < MAX_CHEMICALS; i++) {
-			simulation.curr_cells[id].conc[i] = deviate(cell_parameters.chem_conc[i], cell_parameters.chem_conc_dev[i]);
-			simulation.curr_cells[id].diff[i] = deviate(cell_parameters.chem_diff[i], cell_parameters.chem_diff_dev[i]);
+	for (int i = 0; i < simulation.n_chemicals; i++) {
+			simulation.curr_cells.conc[i][id] = deviate(parameters.chem_conc[i], parameters.chem_conc_dev[i], context.random);
+			simulation.curr_cells.diff[i][id] = deviate(parameters.chem_diff[i], parameters.chem_diff_dev[i], context.random);
 	}
-	simulation.curr_cells[id].fixed  = fixed;
-	simulation.curr_cells[id].marker = false;
+	simulation.curr_cells.fixed[id]  = fixed;
+	simulation.curr_cells.marker[id] = false;
 
     return id;
 }
 
+// cell placed at a random offset from 'x', 'y'
+
+static void create_deviated_cell(SimulationContext& context, float x, float y, float dev, bool fixed)
+{
+	if (dev == 0) {
+		simulation_create_cell(context, x, y, fixed);
+		return;
+	}
+	simulation_create_cell(context, x + deviate(-dev, dev, context.random), y + deviate(-dev, dev, context.random), fixed);
+}
+
 // NOTE: this function is called only during the simulation, triggered by the evaluation of 'divide' rule
 // NOTE: a child cell is added to 'next_cells' only after the current iteration is finished
 
-static void divide_cell(CellId parent_id, CellId id, float direction, float direction_dev)
+static void divide_cell(Simulation& simulation, CellId parent_id, CellId id, float direction)
 {
-	float angle = atan2f(simulation.curr_cells[parent_id].polarity_y, simulation.curr_cells[parent_id].polarity_x);
-	angle += M_PI * deviate(direction, direction_dev) / 180; // change angle by relative direction
+	float angle = atan2f(simulation.curr_cells.polarity_y[parent_id], simulation.curr_cells.polarity_x[parent_id]);
+	angle += M_PI * direction / 180; // change angle by relative direction
 	float dx = cosf(angle);
 	float dy = sinf(angle);
-	float x = simulation.curr_cells[parent_id].x + dx; // displacement == radius
-	float y = simulation.curr_cells[parent_id].y + dy; // displacement == radius
+	float x = simulation.curr_cells.x[parent_id] + dx; // displacement == radius
+	float y = simulation.curr_cells.y[parent_id] + dy; // displacement == radius
 
-	simulation.next_cells[id] = simulation.curr_cells[parent_id]; // copy everything
+	simulation.next_cells.copy(id, simulation.curr_cells, parent_id); // copy everything
 
-	simulation.next_cells[id].birth = simulation.iteration + 1; // new cells are created after current iteration ends
-	simulation.next_cells[id].neighbors = 0;
-	simulation.next_cells[id].x = x;
-	simulation.next_cells[id].y = y;
-	simulation.next_cells[id].polarity_x = dx; // polarity is set to match division direction
-	simulation.next_cells[id].polarity_y = dy; // polarity is set to match division direction
+	simulation.next_cells.birth[id] = simulation.iteration + 1; // new cells are created after current iteration ends
+	simulation.next_cells.neighbors[id] = 0;
+	simulation.next_cells.x[id] = x;
+	simulation.next_cells.y[id] = y;
+	simulation.next_cells.polarity_x[id] = dx; // polarity is set to match division direction
+	simulation.next_cells.polarity_y[id] = dy; // polarity is set to match division direction
 	// chemical concentrations and diffusion rates are the same as parent
-	simulation.next_cells[id].fixed  = false; // division always creates free (non-fixed) cells
-	simulation.next_cells[id].marker = false;
+	simulation.next_cells.fixed[id]  = false; // division always creates free (non-fixed) cells
+	simulation.next_cells.marker[id] = false;
 
 	//std::cout << "child #" << id << " x=" << x << " y=" << y << " dx=" << dx << " dy=" << dy << " birth=" << simulation.iteration << '\n';
 }
 
-void simulation_create_square_grid(int count_x, int count_y, float center_x, float center_y, float dev, bool fixed, bool wrap)
+void simulation_create_square_grid(SimulationContext& context, int count_x, int count_y, float center_x, float center_y, float dev, bool fixed, bool wrap)
 {
-	nns_dim_x = count_x;
-	nns_dim_y = count_y;
-    nns_wrap = wrap;
+	context.nns_dim_x = count_x;
+	context.nns_dim_y = count_y;
+    context.nns_wrap = wrap;
 
     for (int cy = 0; cy < count_y; cy++) {
 		float y = center_y + (cy - count_y / 2.0) * 2 + 1;
     	for (int cx = 0; cx < count_x; cx++) {
     		float x = center_x + (cx - count_x / 2.0) * 2 + 1;
-    		if (dev == 0) {
-    			simulation_create_cell(x, y, fixed);
-    		}
-    		else {
-    			simulation_create_cell(x + deviate(-dev, dev), y + deviate(-dev, dev), fixed);
-    		}
+    		create_deviated_cell(context, x, y, dev, fixed);
 		}
 	}
 }
 
-void simulation_create_square_circle(int count, float center_x, float center_y, float dev, bool fixed)
+void simulation_create_square_circle(SimulationContext& context, int count, float center_x, float center_y, float dev, bool fixed)
 {
     for (int cy = 0; cy < count; cy++) {
 		float y = center_y + (cy - count / 2.0) * 2 + 1;
     	for (int cx = 0; cx < count; cx++) {
     		float x = center_x + (cx - count / 2.0) * 2 + 1;
     		if ((cy - count / 2.0 + 0.5) * (cy - count / 2.0 + 0.5) + (cx - count / 2.0 + 0.5) * (cx - count / 2.0 + 0.5) <= count * count / 4.0) {
-    			if (dev == 0) {
-    				simulation_create_cell(x, y, fixed);
-    			}
-    			else {
-    				simulation_create_cell(x + deviate(-dev, dev), y + deviate(-dev, dev), fixed);
-    			}
+    			create_deviated_cell(context, x, y, dev, fixed);
     		}
 		}
 	}
 }
 
-void simulation_create_hexagonal_grid(int count_x, int count_y, float center_x, float center_y, float dev, bool fixed)
+void simulation_create_hexagonal_grid(SimulationContext& context, int count_x, int count_y, float center_x, float center_y, float dev, bool fixed)
 {
     for (int cy = 0; cy < count_y; cy++) {
 		float y = center_y + (cy - count_y / 2.0) * 1.7321 + 0.866;
@@ -240,17 +326,12 @@ void simulation_create_hexagonal_grid(int count_x, int count_y, float center_x,
     	    if (cy % 2) {
     	        x += 1; // cell radius
     	    }
-    		if (dev == 0) {
-    			simulation_create_cell(x, y, fixed);
-    		}
-    		else {
-    			simulation_create_cell(x + deviate(-dev, dev), y + deviate(-dev, dev), fixed);
-    		}
+    		create_deviated_cell(context, x, y, dev, fixed);
 		}
 	}
 }
 
-void simulation_create_hexagonal_circle(int count, float center_x, float center_y, float dev, bool fixed)
+void simulation_create_hexagonal_circle(SimulationContext& context, int count, float center_x, float center_y, float dev, bool fixed)
 {
     for (int cy = -count; cy < count; cy++) {
 		float y = center_y + cy * 1.7321;
@@ -260,12 +341,7 @@ void simulation_create_hexagonal_circle(int count, float center_x, float center_
 				x += 1; // cell radius
 			}
     		if ((x - center_x) * (x - center_x) + (y - center_y) * (y - center_y) <= count * count) {
-    			if (dev == 0) {
-    				simulation_create_cell(x, y, fixed);
-    			}
-    			else {
-    				simulation_create_cell(x + deviate(-dev, dev), y + deviate(-dev, dev), fixed);
-    			}
+    			create_deviated_cell(context, x, y, dev, fixed);
     		}
 		}
 	}
@@ -273,112 +349,719 @@ void simulation_create_hexagonal_circle(int count, float center_x, float center_
 
 /*-------------------------------- SET FUNCTIONS --------------------------------*/
 
-void simulation_set_cell_concentration(CellId id, int chemical, float value, float deviation)
+void simulation_set_cell_concentration(SimulationContext& context, CellId id, int chemical, float value, float deviation)
 {
-	simulation.curr_cells[id].conc[chemical] = deviate(value, deviation);
+	Simulation& simulation = context.simulation;
+	simulation.curr_cells.conc[chemical][id] = deviate(value, deviation, context.random);
 }
 
-void simulation_set_cell_diffusion(CellId id, int chemical, float value, float deviation)
+void simulation_set_cell_diffusion(SimulationContext& context, CellId id, int chemical, float value, float deviation)
 {
-	simulation.curr_cells[id].diff[chemical] = deviate(value, deviation);
+	Simulation& simulation = context.simulation;
+	simulation.curr_cells.diff[chemical][id] = deviate(value, deviation, context.random);
 }
 
-void simulation_set_cell_polarity(CellId id, float angle, float deviation)
+void simulation_set_cell_polarity(SimulationContext& context, CellId id, float angle, float deviation)
 {
+	Simulation& simulation = context.simulation;
 	if (angle != FLT_MAX) {
-		float a = deviate(angle, deviation);
-		simulation.curr_cells[id].polarity_x = cosf(M_PI * a / 180);
-		simulation.curr_cells[id].polarity_y = sinf(M_PI * a / 180);
+		float a = deviate(angle, deviation, context.random);
+		simulation.curr_cells.polarity_x[id] = cosf(M_PI * a / 180);
+		simulation.curr_cells.polarity_y[id] = sinf(M_PI * a / 180);
 	}
 	else {
-		simulation.curr_cells[id].polarity_x = simulation.curr_cells[id].polarity_y = 0;
+		simulation.curr_cells.polarity_x[id] = simulation.curr_cells.polarity_y[id] = 0;
 	}
 }
 
-void simulation_set_cell_fixed(CellId id, bool fixed)
+void simulation_set_cell_fixed(SimulationContext& context, CellId id, bool fixed)
 {
-	simulation.curr_cells[id].fixed = fixed;
+	context.simulation.curr_cells.fixed[id] = fixed;
 }
 /*-------------------------------- RULE FUNCTIONS --------------------------------*/
 
-void simulation_add_rule(const Rule& rule)
+void simulation_add_rule(SimulationContext& context, const Rule& rule)
 {
+	Simulation& simulation = context.simulation;
 	simulation.rules.push_back(rule);
 
 	if (rule.action == DIVIDE) {
-		nns_dim_x = nns_dim_y = 0; // do not use square grid nns
+		context.nns_dim_x = context.nns_dim_y = 0; // do not use square grid nns
+	}
+}
+
+/*-------------------------------- REORDER FUNCTIONS --------------------------------*/
+
+// cell ids follow creation order, and children of divisions are appended at the end, so over time neighbors end up far
+// apart in memory; renumbering cells along a Morton (Z-order) curve makes memory order follow spatial order again
+
+// mean distance between cells with consecutive ids: about one cell diameter when ids follow positions
+static float get_locality(const Simulation& simulation)
+{
+	const CellArray& cells = simulation.curr_cells;
+	double sum = 0;
+	for (int id = 1; id < simulation.n_cells; id++) {
+		float dx = cells.x[id] - cells.x[id - 1];
+		float dy = cells.y[id] - cells.y[id - 1];
+		sum += sqrtf(dx * dx + dy * dy);
 	}
+	return (simulation.n_cells > 1) ? sum / (simulation.n_cells - 1) : 0;
+}
+
+// interleave the lower 16 bits of 'v' with zeros
+static unsigned int spread_bits(unsigned int v)
+{
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+static void reorder_cells(SimulationContext& context)
+{
+	Simulation& simulation = context.simulation;
+	int n_cells = simulation.n_cells;
+	CellArray& cells = simulation.curr_cells;
+	if (n_cells < 2) {
+		return;
+	}
+
+	float min_x = cells.x[0], max_x = cells.x[0];
+	float min_y = cells.y[0], max_y = cells.y[0];
+	for (int id = 1; id < n_cells; id++) {
+		min_x = std::min(min_x, cells.x[id]); max_x = std::max(max_x, cells.x[id]);
+		min_y = std::min(min_y, cells.y[id]); max_y = std::max(max_y, cells.y[id]);
+	}
+	float scale = 65535 / std::max(std::max(max_x - min_x, max_y - min_y), 1e-6f);
+
+	// sort by Morton key, ties broken by id so that the order does not depend on the sort algorithm
+	std::vector<std::pair<unsigned int, int> > keys(n_cells);
+	for (int id = 0; id < n_cells; id++) {
+		unsigned int qx = (unsigned int) ((cells.x[id] - min_x) * scale);
+		unsigned int qy = (unsigned int) ((cells.y[id] - min_y) * scale);
+		keys[id] = std::make_pair(spread_bits(qx) | (spread_bits(qy) << 1), id);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<int> order(n_cells);
+	std::vector<CellId> new_ids(n_cells);
+	for (int i = 0; i < n_cells; i++) {
+		order[i] = keys[i].second;
+		new_ids[keys[i].second] = (CellId) i;
+	}
+
+	// 'next_cells' is overwritten by the next step, so only current cells and everything referring to them move
+	cells.permute(order);
+	for (int i = 0; i < (int) simulation.mirror_list.size(); i++) {
+		simulation.mirror_list[i].first  = new_ids[simulation.mirror_list[i].first];
+		simulation.mirror_list[i].second = new_ids[simulation.mirror_list[i].second];
+	}
+	if (simulation.tracked_id != -1) {
+		simulation.tracked_id = new_ids[simulation.tracked_id];
+	}
+	context.nns->remap_cell_ids(new_ids);
+	if (context.neighbor_list) {
+		context.neighbor_list->invalidate();
+	}
+
+	context.reorder_locality = get_locality(simulation);
 }
 
 /*-------------------------------- SIMULATION FUNCTIONS --------------------------------*/
 
-void simulation_init(NNSChoice nns_choice, bool detect_stability)
+void simulation_init(SimulationContext& context, NNSChoice nns_choice, bool detect_stability, int n_threads, CacheChoice cache_choice, float verlet_skin, bool reorder_cells_by_position)
 {
+	Simulation& simulation = context.simulation;
+	Statistics& statistics = context.statistics;
+	std::ostream& log = *context.log;
+
+	NNS *nns = NULL;
 	switch (nns_choice) {
 	case AUTO:
-		if (nns_dim_x && nns_dim_y) {
-			nns = new NNS_SquareGrid(nns_dim_x, nns_dim_y, nns_wrap);
-			std::cout << "nns: using square grid " << nns_dim_x << " x " << nns_dim_y << " wrap=" << nns_wrap << " (auto)\n";
-		}
-		else if (simulation.domain_is_packed) {
-			nns = new NNS_SpatialSorting(48);
-			std::cout << "nns: using spatial sorting with neighborhood m=48 (auto)\n";
+		if (context.nns_dim_x && context.nns_dim_y) {
+			nns = new NNS_SquareGrid(context.nns_dim_x, context.nns_dim_y, context.nns_wrap);
+			log << "nns: using square grid " << context.nns_dim_x << " x " << context.nns_dim_y << " wrap=" << context.nns_wrap << " (auto)\n";
 		}
 		else {
-			nns = new NNS_KD_Tree();
-			std::cout << "nns: using k-d tree (auto)\n";
+			// exact, and faster than both spatial sorting (packed domains) and the k-d tree (irregular tissues)
+			nns = new NNS_CellList();
+			log << "nns: using cell list (auto)\n";
 		}
 		break;
 	case SPATIAL_SORTING:
 		nns = new NNS_SpatialSorting(48);
-		std::cout << "nns: using spatial sorting with neighborhood m=48\n";
+		log << "nns: using spatial sorting with neighborhood m=48\n";
 		break;
 	case KD_TREE:
 		nns = new NNS_KD_Tree();
-		std::cout << "nns: using k-d tree\n";
+		log << "nns: using k-d tree\n";
+		break;
+	case CELL_LIST:
+		nns = new NNS_CellList();
+		log << "nns: using cell list\n";
 		break;
 	}
+	context.nns = nns;
 	simulation.detect_stability = detect_stability;
 
+	simulation.n_threads = (n_threads < 1) ? 1 : n_threads;
+	context.workers = new WorkerPool(simulation.n_threads);
+	// rules are compiled once; constants never change, so they are copied to the registers of each thread only here
+	context.program.compile(simulation.rules);
+
+	const Program& program = context.program;
+	context.thread_states.resize(simulation.n_threads);
+	for (int t = 0; t < simulation.n_threads; t++) {
+		ThreadState& ts = context.thread_states[t];
+		ts.thread = t;
+		ts.registers.assign(program.n_registers, 0);
+		std::copy(program.constants.begin(), program.constants.end(), ts.registers.begin() + REG_CONSTANTS);
+	}
+	if (simulation.n_threads > 1) {
+		log << "sim: using " << simulation.n_threads << " threads\n";
+	}
+	log << "sim: using " << diffusion_init() << " diffusion kernel\n";
+
+	// exact neighborhoods are worth caching when cells usually keep still, as without move or divide rules
+	if (cache_choice == CACHE_AUTO) {
+		cache_choice = CACHE_STATIC;
+		for (int r = 0; r < (int) simulation.rules.size(); r++) {
+			if (simulation.rules[r].action == MOVE || simulation.rules[r].action == DIVIDE) {
+				cache_choice = CACHE_OFF;
+			}
+		}
+	}
+	// neighbors in the square grid do not depend on distance, so they cannot be filtered from Verlet candidates
+	if (cache_choice == CACHE_VERLET && dynamic_cast<NNS_SquareGrid*>(nns)) {
+		log << "sim: verlet lists are not used with square grid\n";
+		cache_choice = CACHE_OFF;
+	}
+	if (cache_choice == CACHE_STATIC) {
+		context.neighbor_list = new NeighborList(simulation.n_threads);
+		log << "sim: caching neighbor lists\n";
+	}
+	else if (cache_choice == CACHE_VERLET) {
+		if (verlet_skin <= 0) {
+			std::cout << "error: verlet skin must be positive\n";
+			exit(1);
+		}
+		context.neighbor_list = new NeighborList(simulation.n_threads, verlet_skin);
+		log << "sim: using verlet lists with skin " << verlet_skin << '\n';
+	}
+
+	// a restored simulation gets back the order its positions had in the NNS, and its cells are already reordered
+	bool restored = ((int) context.nns_order.size() == simulation.n_cells && simulation.n_cells > 0);
+
 	statistics.start();
 	for (CellId id = CellId(0); id < simulation.n_cells; id++) {
-		statistics.update(simulation.curr_cells[id], simulation.n_chemicals);
-		nns->add_position(simulation.curr_cells[id].x, simulation.curr_cells[id].y, id);
+		Cell cell;
+		simulation.curr_cells.load(id, cell);
+		statistics.update(cell, simulation.n_chemicals);
+		if (!restored) {
+			nns->add_position(simulation.curr_cells.x[id], simulation.curr_cells.y[id], id);
+		}
 	}
 	statistics.finish(simulation.n_cells);
+	if (restored) {
+		for (int i = 0; i < simulation.n_cells; i++) {
+			CellId id = context.nns_order[i];
+			nns->add_position(simulation.curr_cells.x[id], simulation.curr_cells.y[id], id);
+		}
+	}
+	context.nns_order.clear();
 
-	//time_nns_setup = /*time_evaluate = time_nns_query = time_interact*/ time_calculate = time_total = 0;
+	// ids in the square grid are grid coordinates
+	context.reorder = reorder_cells_by_position;
+	if (context.reorder && dynamic_cast<NNS_SquareGrid*>(nns)) {
+		log << "sim: cells are not reordered with square grid\n";
+		context.reorder = false;
+	}
+	if (context.reorder && !restored) {
+		reorder_cells(context);
+		log << "sim: reordering cells by position\n";
+	}
 }
 
-static float get_parameter(Parameter par, float val, CellId id)
+// geometry of the 'n' candidate neighbors of a cell at 'x', 'y', stored with their ids in the thread state; a wrapped
+// neighbor is relocated into a nearby position, unless 'filter' is set, in which case candidates out of range are dropped
+
+static int gather_neighbors(const CellArray& cells, const CellId *candidates, int n, float x, float y, bool filter, ThreadState& ts)
 {
-	if (par == CONSTANT) {
-		return val;
-	}
-	else if (par == NEIGHBORS) {
-		return simulation.curr_cells[id].neighbors;
-	}
-	else if (par == AGE) {
-		return simulation.iteration - simulation.curr_cells[id].birth;
-	}
-	else if (par == BIRTH) {
-		return simulation.curr_cells[id].birth;
-	}
-	else if (par < MAX_CHEMICALS) {
-		return simulation.curr_cells[id].conc[par];
+	int n_neighbors = 0;
+
+	// NOTE: 'candidates' may be 'ts.neighbors' itself, as each entry is written at or before the one being read
+	for (int i = 0; i < n; i++) {
+		const CellId neig_id = candidates[i];
+
+		float dx = cells.x[neig_id] - x;
+		float dy = cells.y[neig_id] - y;
+		float sqr_norm = dx * dx + dy * dy;
+
+		if (filter) {
+			if (sqr_norm > INFLUENCE_RANGE * INFLUENCE_RANGE) {
+				continue;
+			}
+		}
+		else if (sqr_norm > INFLUENCE_RANGE * INFLUENCE_RANGE) {
+			// relocate a wrapped neighbor into a nearby position
+			if (dx > INFLUENCE_RANGE) {
+				dx = -2;
+			}
+			else if (dx < - INFLUENCE_RANGE) {
+				dx = 2;
+			}
+			if (dy > INFLUENCE_RANGE) {
+				dy = -2;
+			}
+			else if (dy < - INFLUENCE_RANGE) {
+				dy = 2;
+			}
+			sqr_norm = dx * dx + dy * dy;
+		}
+
+		ts.neighbors[n_neighbors] = neig_id;
+		ts.dx[n_neighbors] = dx;
+		ts.dy[n_neighbors] = dy;
+		ts.norm[n_neighbors] = sqrtf(sqr_norm);
+		n_neighbors++;
 	}
-	else if (par < 2 * MAX_CHEMICALS) {
-		return simulation.curr_cells[id].diff[par - MAX_CHEMICALS];
+	return n_neighbors;
+}
+
+// NOTE: this function only reads 'curr_cells' and writes its own slot in 'next_cells', so positions can be processed in parallel
+
+static void simulation_process_position(SimulationContext& context, int index, ThreadState& ts)
+{
+	Simulation& simulation = context.simulation;
+	const Program& program = context.program;
+	NeighborList *neighbor_list = context.neighbor_list;
+	NNS *nns = context.nns;
+
+	int n_chemicals = simulation.n_chemicals;
+	int n_mappings = (int) simulation.mappings.size();
+
+    float dt = simulation.time_step;
+
+    // per-cell phases are timed on a sample of the cells only
+    Stopwatch watch(context.profiler.enabled && index % PROFILE_SAMPLING == 0, ts.times);
+
+    const CellId curr_id = nns->get_cell_id(index);
+    const CellArray& cells = simulation.curr_cells;
+
+    // gather only the attributes of defined chemicals for the current cell
+    Cell curr_cell;
+    cells.load(curr_id, curr_cell);
+
+    // copy current cell values as base for next cell, with whole-tissue reactions already applied
+    Cell next_cell = curr_cell;
+    next_cell.marker = false;
+    for (int i = 0; i < (int) program.reacted.size(); i++) {
+    	int ch = program.reacted[i];
+    	next_cell.conc[ch] = simulation.next_cells.conc[ch][curr_id];
+    }
+
+    int polarity_source = -1; // do not compute polarity by default, unless a rule defines a source concentration or diffusion
+
+    // registers belong to this cell only
+    float *regs = ts.registers.data();
+    for (int ch = 0; ch < n_chemicals; ch++) {
+    	regs[ch] = curr_cell.conc[ch];
+    	regs[MAX_CHEMICALS + ch] = curr_cell.diff[ch];
+    }
+    // mapped values start at 0 in every cell and are only seen by later rules of the same cell
+    for (int m = 0; m < n_mappings; m++) {
+    	regs[2 * MAX_CHEMICALS + m] = 0;
+    }
+    if (program.uses_cell_attributes) {
+    	regs[REG_NEIGHBORS] = curr_cell.neighbors;
+    	regs[REG_AGE] = simulation.iteration - curr_cell.birth;
+    	regs[REG_BIRTH] = curr_cell.birth;
+    }
+
+	/*---------------- process rules for current cell ----------------*/
+
+    const Instruction *code = program.code.data();
+    int n_code = (int) program.code.size();
+    for (int i = 0; i < n_code; i++) {
+    	const Instruction& in = code[i];
+
+    	// evaluate the fused chain of predicates
+    	bool is_active = true;
+    	for (int c = 0; c < (int) in.conditions.size(); c++) {
+    		const Condition& cond = in.conditions[c];
+    		bool holds;
+    		switch (cond.predicate) {
+    		case IF_EQUAL:         holds = (regs[cond.op[0]] == regs[cond.op[1]]); break;
+    		case IF_NOT_EQUAL:     holds = (regs[cond.op[0]] != regs[cond.op[1]]); break;
+    		case IF_LESS_THAN:     holds = (regs[cond.op[0]] <  regs[cond.op[1]]); break;
+    		case IF_LESS_EQUAL:    holds = (regs[cond.op[0]] <= regs[cond.op[1]]); break;
+    		case IF_GREATER_THAN:  holds = (regs[cond.op[0]] >  regs[cond.op[1]]); break;
+    		case IF_GREATER_EQUAL: holds = (regs[cond.op[0]] >= regs[cond.op[1]]); break;
+    		case IF_IN_INTERVAL:   holds = (regs[cond.op[1]] <= regs[cond.op[0]] && regs[cond.op[0]] <= regs[cond.op[2]]); break;
+    		case PROBABILITY:      holds = (rand_range(0, 1, simulation, curr_id, cond.rule, DRAW_CONDITION) <= regs[cond.op[0]]); break;
+    		default:               holds = false; break;
+    		}
+    		if (!holds) {
+    			is_active = false;
+    			break;
+    		}
+    	}
+    	if (!is_active) {
+    		continue;
+    	}
+
+    	// perform actions
+    	switch (in.action) {
+    	case REACT_GS: {
+    		// current concentrations
+    		float u = regs[in.op[0]];
+    		float v = regs[in.op[1]];
+    		float s = regs[in.op[2]];
+    		float f = regs[in.op[3]];
+    		float k = regs[in.op[4]];
+
+    		// reaction terms
+    		next_cell.conc[in.op[0]] += s * (-u * v * v + f * (1 - u)) * dt;
+    		next_cell.conc[in.op[1]] += s * ( u * v * v - (f + k) * v) * dt;
+    		break;
+    	}
+    	case REACT_TU: {
+    		// current concentrations
+    		float u = regs[in.op[0]];
+    		float v = regs[in.op[1]];
+    		float s = regs[in.op[2]];
+    		float alpha = regs[in.op[3]];
+    		float beta = regs[in.op[4]];
+
+    		// reaction terms
+    		next_cell.conc[in.op[0]] += s * (alpha - u * v)    * dt;
+    		next_cell.conc[in.op[1]] += s * (u * v - v - beta) * dt;
+    		break;
+    	}
+    	case REACT_LI: {
+    		// current concentrations
+    		float u = regs[in.op[0]];
+    		float s = regs[in.op[2]];
+    		float a = regs[in.op[3]];
+    		float b = regs[in.op[4]];
+
+    		// reaction terms
+    		next_cell.conc[in.op[0]] += s * (a * u - b) * dt;
+    		break;
+    	}
+    	case REACT_CU: {
+    		// current concentrations
+    		float u = regs[in.op[0]];
+    		float s = regs[in.op[2]];
+    		float a = regs[in.op[3]];
+    		float b = regs[in.op[4]];
+    		float c = regs[in.op[5]];
+
+    		// reaction terms
+    		next_cell.conc[in.op[0]] += s * (u - a) * (u - b) * (u - c) * dt;
+    		break;
+    	}
+    	case CHANGE: {
+    		float val = regs[in.op[1]];
+    		float dev = regs[in.op[2]];
+    		if (in.op[0] < MAX_CHEMICALS) {
+    			// concentration
+    			next_cell.conc[in.op[0]] += deviate(val, dev, simulation, curr_id, in.rule, DRAW_ACTION);
+    		}
+    		else {
+    			// diffusion rate
+    			float& diff = next_cell.diff[in.op[0] - MAX_CHEMICALS];
+    			diff += deviate(val, dev, simulation, curr_id, in.rule, DRAW_ACTION);
+
+    			// we check for negative diffusion only after a change action; there is no need to test after each iteration
+    			if (diff < 0) {
+    				diff = 0;
+    			}
+    		}
+    		break;
+    	}
+    	case MAP: {
+    		float val = regs[in.op[0]];
+    		float map;
+    		if (val < in.map_source[0]) {
+    			map = in.map_target[0];
+    		}
+    		else if (val > in.map_source[1]) {
+    			map = in.map_target[1];
+    		}
+    		else {
+    			// linearly interpolate 'val' into 'map'
+    			map = ((val - in.map_source[0]) / in.map_source_width) * in.map_target_width + in.map_target[0];
+    		}
+    		regs[in.op[3]] = map;
+    		break;
+    	}
+    	case POLARIZE:
+    		polarity_source = in.op[0];
+    		next_cell.polarity_x = next_cell.polarity_y = 0;
+    		break;
+    	case DIVIDE:
+    		if (simulation.division_limit == 0 || curr_cell.neighbors <= simulation.division_limit) {
+    			float dir = regs[in.op[0]];
+    			float dev = regs[in.op[1]];
+
+    			// the child cell is created after all positions are processed, so cell ids do not depend on the number of threads
+    			Division division;
+    			division.parent_id = curr_id;
+    			division.direction = deviate(dir, dev, simulation, curr_id, in.rule, DRAW_ACTION);
+    			ts.divisions.push_back(division);
+    		}
+    		break;
+    	case MOVE: {
+    		float val = regs[in.op[0]];
+    		float dev = regs[in.op[1]];
+    		float offset = deviate(val, dev, simulation, curr_id, in.rule, DRAW_ACTION);
+    		next_cell.x += curr_cell.polarity_x * offset;
+    		next_cell.y += curr_cell.polarity_y * offset;
+    		break;
+    	}
+    	default:
+    		break;
+    	}
+    }
+
+    watch.lap(PHASE_EVALUATE);
+
+    /*---------------- locate and interact with nearest neighbors ----------------*/
+
+    const CellId *row_ids;
+    const float *row_dx, *row_dy, *row_norm;
+    int n_neighbors = 0;
+
+    if (neighbor_list && neighbor_list->is_built() && neighbor_list->has_geometry()) {
+    	// no cell moved since the neighborhoods were cached
+    	int offset = neighbor_list->offsets[curr_id];
+    	n_neighbors = neighbor_list->counts[curr_id];
+    	row_ids  = neighbor_list->ids.data() + offset;
+    	row_dx   = neighbor_list->dx.data() + offset;
+    	row_dy   = neighbor_list->dy.data() + offset;
+    	row_norm = neighbor_list->norm.data() + offset;
+    }
+    else {
+    	const CellId *candidates;
+    	int n_candidates = 0;
+    	bool verlet = neighbor_list && !neighbor_list->has_geometry();
+
+    	if (verlet && neighbor_list->is_built()) {
+    		// candidates from a Verlet list still valid
+    		candidates = neighbor_list->ids.data() + neighbor_list->offsets[curr_id];
+    		n_candidates = neighbor_list->counts[curr_id];
+    	}
+    	else {
+    		// get all neighbors within range, or all candidates within range plus skin for a Verlet list
+    		float range = verlet ? neighbor_list->get_radius() : INFLUENCE_RANGE;
+    		candidates = nns->query_position_range(index, range, ts.neighbors);
+    		while (candidates[n_candidates] != -1) {
+    			n_candidates++;
+    		}
+    		if (verlet) {
+    			neighbor_list->record(ts.thread, curr_id, n_candidates, candidates, NULL, NULL, NULL);
+    		}
+    	}
+
+    	n_neighbors = gather_neighbors(cells, candidates, n_candidates, curr_cell.x, curr_cell.y, verlet, ts);
+    	row_ids  = ts.neighbors;
+    	row_dx   = ts.dx;
+    	row_dy   = ts.dy;
+    	row_norm = ts.norm;
+    	if (neighbor_list && !verlet) {
+    		neighbor_list->record(ts.thread, curr_id, n_neighbors, row_ids, row_dx, row_dy, row_norm);
+    	}
+    }
+
+    watch.lap(PHASE_NEIGHBORS);
+
+    /*---------------- account diffusion from neighbors --------------*/
+
+    // anisotropic weights depend only on the geometry, so they are shared by all chemicals
+    const float *weights = NULL;
+    if (context.any_anisotropic) {
+    	float px = curr_cell.polarity_x; // main direction vector -- must be normalized
+    	float py = curr_cell.polarity_y;
+    	for (int k = 0; k < n_neighbors; k++) {
+    		ts.weights[k] = (px != 0 || py != 0) ? fabs(row_dx[k] * px + row_dy[k] * py) / row_norm[k] : 1;
+    	}
+    	weights = ts.weights;
+    }
+
+    for (int ch = 0; ch < n_chemicals; ch++) {
+    	next_cell.conc[ch] += diffusion_sum(cells.conc[ch], cells.diff[ch], row_ids, simulation.chemicals[ch].anisotropic ? weights : NULL,
+    			n_neighbors, curr_cell.conc[ch], curr_cell.diff[ch]) * dt;
+
+    	// this check would prevent chemical production when using a negative diffusion rate, but it is too expensive
+    	// if ((neig_cell.diff[ch] < 0 || curr_cell.diff[ch] < 0) && (neig_cell.conc[ch] <= 0 || curr_cell.conc[ch] <= 0))
+    	// { do not diffuse } else { diffuse normally }
+    }
+
+    // iterate through all neighbors
+    for (int k = 0; k < n_neighbors; k++) {
+        const CellId neig_id = row_ids[k];
+        const float dx = row_dx[k];
+        const float dy = row_dy[k];
+        const float norm = row_norm[k];
+
+        // define polarity for this cell, calculating gradient for reference chemical concentration
+        if (polarity_source != -1)
+        {
+        	next_cell.polarity_x += (cells.conc[polarity_source][neig_id] - curr_cell.conc[polarity_source]) * dx / norm;
+        	next_cell.polarity_y += (cells.conc[polarity_source][neig_id] - curr_cell.conc[polarity_source]) * dy / norm;
+
+        	// IDEA: to calculate vector pointing to inside of tissue; usable only for cells with 4 or less neighbors
+        	// next_cell.polarity_x += dx / norm;
+        	// next_cell.polarity_y += dy / norm;
+        }
+
+        // FIXME: this is a hack for finding nearest neighbors
+        if (neig_id == simulation.tracked_id) {
+        	next_cell.marker = true;
+        }
+
+        /*---------------- collision --------------*/
+
+        if (curr_cell.fixed == false) {
+			// VERY GOOD COLLISION: simpler, quick to stabilize and fewer holes
+			if (0 < norm && norm < 2) {
+				// NOTE: 2 is the sum of curr and neig radii
+				// NOTE: weight factor was 0.2 -> makes possible large concentrations of cells
+				// NOTE: the original collision code for distinct radii was
+				// float sr = curr_cell.r + neig_cell.r;
+				// float weight = 0.5 * curr_cell.r * (1 / norm) * (sr - norm) / sr;
+				// next_cell.x -= weight * dx;
+				// next_cell.y -= weight * dy;
+
+				next_cell.x -= (0.5 / norm - 0.25) * dx;
+				next_cell.y -= (0.5 / norm - 0.25) * dy;
+			}
+        }
+    }
+    next_cell.neighbors = n_neighbors;
+
+    watch.lap(PHASE_INTERACT);
+
+#ifdef NNS_PRECISION
+    // positions in 'exact' are stored in cell id order
+    CellId *neighbor = context.exact->query_position_range(curr_id, INFLUENCE_RANGE, ts.neighbors);
+    int c = 0;
+    while ((*neighbor) != -1) {
+    	neighbor++;
+    	c++;
+    }
+	next_cell.error = c - n_neighbors;
+    if (n_neighbors != c) {
+    	ts.miss_cells++;
+    	ts.miss_neighbors += c - n_neighbors;
+    	//std::cout << "cell=" << curr_id << " #ss=" << n_neighbors << " #exact=" << c << '\n';
+    }
+    ts.total_neighbors += c;
+#endif // NNS_PRECISION
+
+    /*---------------- limit final position and concentrations --------------*/
+
+    if      (next_cell.x < simulation.domain_xmin) { next_cell.x = simulation.domain_xmin; }
+    else if (next_cell.x > simulation.domain_xmax) { next_cell.x = simulation.domain_xmax; }
+
+    if      (next_cell.y < simulation.domain_ymin) { next_cell.y = simulation.domain_ymin; }
+    else if (next_cell.y > simulation.domain_ymax) { next_cell.y = simulation.domain_ymax; }
+
+   	for (int ch = 0; ch < n_chemicals; ch++) {
+   		// clamping concentrations at zero is needed for Turing RD, or it would have numerical problems
+   		if      (next_cell.conc[ch] < 0)                              { next_cell.conc[ch] = 0; }
+   		else if (next_cell.conc[ch] > simulation.chemicals[ch].limit) { next_cell.conc[ch] = simulation.chemicals[ch].limit; }
+
+   		// diffusion does not need to be checked here, as it is only set by the experiment or altered by a change action
+   		// if (next_cell.diff[c] < 0) { next_cell.diff[c] = 0; }
+   	}
+
+    /*---------------- normalize polarity vector --------------*/
+
+   	if (polarity_source != -1)
+   	{
+   		float n = sqrtf(next_cell.polarity_x * next_cell.polarity_x + next_cell.polarity_y * next_cell.polarity_y);
+   		if (n > 0.0001) {
+   			next_cell.polarity_x /= n;
+   			next_cell.polarity_y /= n;
+   		}
+   		else {
+   			// previous polarity is now maintained in the absence of chemical gradient
+   			next_cell.polarity_x = curr_cell.polarity_x;
+   			next_cell.polarity_y = curr_cell.polarity_y;
+   			// NOTE: previously it was forced to zero
+   			// next_cell.polarity_x = next_cell.polarity_y = 0;
+   		}
+   	}
+
+   	// IDEA: when calculating vectors pointing to inside of tissue: cells with more than 4 neighbors should not polarize
+   	// if (n_neighbors > 4) {
+   	//	 next_cell.polarity_x = next_cell.polarity_y = 0;
+   	// }
+
+    /*---------------- store modified cell and update statistics --------------*/
+
+   	simulation.next_cells.store(curr_id, next_cell);
+   	ts.statistics.update(next_cell, n_chemicals);
+
+   	watch.lap(PHASE_CLAMP);
+}
+
+// each thread applies whole-tissue reactions to a contiguous range of cell ids
+
+static void simulation_react_range(int thread, int n_threads, void *data)
+{
+	SimulationContext& context = *(SimulationContext*) data;
+	Simulation& simulation = context.simulation;
+
+	int begin, end;
+	WorkerPool::split(simulation.n_cells, thread, n_threads, begin, end);
+	reaction_run(context.program, simulation.curr_cells, simulation.next_cells, simulation.time_step, begin, end);
+}
+
+// each thread processes a contiguous range of positions, in the order defined by the NNS
+
+static void simulation_process_range(int thread, int n_threads, void *data)
+{
+	SimulationContext& context = *(SimulationContext*) data;
+	NeighborList *neighbor_list = context.neighbor_list;
+
+	ThreadState& ts = context.thread_states[thread];
+	ts.statistics.start();
+	ts.divisions.clear();
+	std::fill(ts.times, ts.times + N_PHASES, 0.0);
+	if (neighbor_list && !neighbor_list->is_built()) {
+		neighbor_list->start_recording(thread);
 	}
-	else {
-		return simulation.curr_mappings[par - 2 * MAX_CHEMICALS];
+#ifdef NNS_PRECISION
+	ts.miss_cells = ts.miss_neighbors = ts.total_neighbors = 0;
+#endif // NNS_PRECISION
+
+	// the whole range is timed too, to scale up the times of the sampled cells
+	Stopwatch watch(context.profiler.enabled, ts.times);
+	int begin, end;
+	WorkerPool::split(context.nns->get_position_count(), thread, n_threads, begin, end);
+	for (int index = begin; index < end; index++) {
+		simulation_process_position(context, index, ts);
 	}
+	watch.lap(PHASE_CELLS);
 }
 
-void simulation_single_step()
+static void simulation_single_step(SimulationContext& context)
 {
-	//struct timespec start, end, t0, t1, t2; //, t3;
-	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+	Simulation& simulation = context.simulation;
+	Statistics& statistics = context.statistics;
+	Profiler& profiler = context.profiler;
+	Program& program = context.program;
+	NeighborList *neighbor_list = context.neighbor_list;
+	NNS *nns = context.nns;
+
+	if (profiler.enabled) {
+		profiler.start_iteration();
+	}
 
 	/*---------------- packed domain ----------------*/
 	if (simulation.domain_is_packed) {
@@ -402,392 +1085,83 @@ void simulation_single_step()
 	}
 
 #ifdef NNS_PRECISION
-	NNS *exact = new NNS_KD_Tree();
+	context.exact = new NNS_KD_Tree();
 	for (CellId id = CellId(0); id < simulation.n_cells; id++) {
-		exact->add_position(simulation.curr_cells[id].x, simulation.curr_cells[id].y, id);
+		context.exact->add_position(simulation.curr_cells.x[id], simulation.curr_cells.y[id], id);
 	}
-	exact->setup();
+	context.exact->setup();
 	int miss_cells = 0, miss_neighbors = 0, total_neighbors = 0;
 #endif // NNS_PRECISION
 
 	/*---------------- setup phase ----------------*/
 
-	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t0);
+	// drop rules outside their interval for this iteration
+	program.select(simulation.iteration);
 
-	nns->setup();
+	Stopwatch watch(profiler.enabled, profiler.current);
 
-	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t1);
-    //time_nns_setup += (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) * 0.000001;
+	// the NNS is needed only when neighborhoods are not cached, or some cell moved since they were
+	bool cached = neighbor_list && neighbor_list->validate(simulation.curr_cells, simulation.n_cells);
+	if (!cached) {
+		nns->setup();
+	}
+	watch.lap(PHASE_NNS_SETUP);
 
 	/*---------------- gather / calculation phase ----------------*/
 
-	statistics.start();
-
 	int n_cells = simulation.n_cells; // new cells will be processed by the next simulation step
 	int n_divisions = 0; // number of cells created by division
 
 	int n_chemicals = simulation.n_chemicals;
-	int n_rules = (int) simulation.rules.size();
-
-    float dt = simulation.time_step;
 
     /*---------------- iterate through all cells ----------------*/
 
-    nns->set_start_position();
-    while (nns->has_next_position()) {
-
-    	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t0);
-
-        const CellId curr_id = nns->get_current_cell_id();
-        const Cell& curr_cell = simulation.curr_cells[curr_id];
-
-        // copy current cell values as base for next cell
-        Cell next_cell = curr_cell;
-        next_cell.marker = false;
-
-        int polarity_source = -1; // do not compute polarity by default, unless a rule defines a source concentration or diffusion
-
-    	/*---------------- process rules for current cell ----------------*/
-
-        bool logical_and = false;
-        bool last_predicate = false;
-        for (int r = 0; r < n_rules; r++) {
-        	const Rule& rule = simulation.rules[r];
-
-        	// evaluate iteration interval
-        	if (simulation.iteration < rule.from || rule.until < simulation.iteration) {
-        		if (rule.action == AND) {
-        			// even if outside the interval, we must start a LOGICAL AND to affect next rule(s)
-        			logical_and = true;
-        			last_predicate = false;
-        		}
-        		// skip this rule
-        		continue;
-        	}
-
-        	// evaluate predicates
-        	bool is_active = false;
-        	if (rule.predicate == ALWAYS) {
-        		is_active = true;
-        	}
-        	else if (rule.predicate == IF_EQUAL) {
-        		is_active = (get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id) == get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id));
-        	}
-        	else if (rule.predicate == IF_NOT_EQUAL) {
-        		is_active = (get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id) != get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id));
-        	}
-        	else if (rule.predicate == IF_LESS_THAN) {
-        		is_active = (get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id) < get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id));
-        	}
-        	else if (rule.predicate == IF_LESS_EQUAL) {
-        		is_active = (get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id) <= get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id));
-        	}
-        	else if (rule.predicate == IF_GREATER_THAN) {
-        		is_active = (get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id) > get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id));
-        	}
-        	else if (rule.predicate == IF_GREATER_EQUAL) {
-        		is_active = (get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id) >= get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id));
-        	}
-        	else if (rule.predicate == IF_IN_INTERVAL) {
-        		float v = get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id);
-        		is_active = (get_parameter(rule.pr_par[1], rule.pr_val[1], curr_id) <= v && v <= get_parameter(rule.pr_par[2], rule.pr_val[2], curr_id));
-        	}
-        	else if (rule.predicate == PROBABILITY) {
-        		is_active = (rand_range(0, 1) <= get_parameter(rule.pr_par[0], rule.pr_val[0], curr_id));
-        	}
-        	else {
-        		std::cout << "unknown predicate in rule " << r << '\n';
-				exit(1);
-        	}
-
-        	// implement logical AND for two or more rules
-        	if (logical_and) {
-        		logical_and = false;
-        		is_active = last_predicate && is_active;
-        	}
-    		if (rule.action == AND) {
-    			logical_and = true;
-    			last_predicate = is_active;
-    			continue; // skip to next rule
-    		}
+	if (!program.reactions.empty()) {
+		context.workers->run(simulation_react_range, &context);
+	}
+	watch.lap(PHASE_REACTIONS);
+	context.workers->run(simulation_process_range, &context);
+	watch.lap(PHASE_CELLS);
 
-        	// perform actions
-        	if (is_active) {
-        		if (rule.action == REACT_GS) {
-        	        // current concentrations
-        	        float u = curr_cell.conc[rule.ac_par[0]];
-        	        float v = curr_cell.conc[rule.ac_par[1]];
-        	        float s = get_parameter(rule.ac_par[2], rule.ac_val[2], curr_id);
-        	        float f = get_parameter(rule.ac_par[3], rule.ac_val[3], curr_id);
-        	        float k = get_parameter(rule.ac_par[4], rule.ac_val[4], curr_id);
-
-        	        // reaction terms
-        	        next_cell.conc[rule.ac_par[0]] += s * (-u * v * v + f * (1 - u)) * dt;
-        	        next_cell.conc[rule.ac_par[1]] += s * ( u * v * v - (f + k) * v) * dt;
-        		}
-        		else if (rule.action == REACT_TU) {
-        	        // current concentrations
-        	        float u = curr_cell.conc[rule.ac_par[0]];
-        	        float v = curr_cell.conc[rule.ac_par[1]];
-        	        float s = get_parameter(rule.ac_par[2], rule.ac_val[2], curr_id);
-        	        float alpha = get_parameter(rule.ac_par[3], rule.ac_val[3], curr_id);
-        	        float beta = get_parameter(rule.ac_par[4], rule.ac_val[4], curr_id);
-
-        	        // reaction terms
-        	        next_cell.conc[rule.ac_par[0]] += s * (alpha - u * v)    * dt;
-        	        next_cell.conc[rule.ac_par[1]] += s * (u * v - v - beta) * dt;
-        		}
-        		else if (rule.action == REACT_LI) {
-        	        // current concentrations
-        	        float u = curr_cell.conc[rule.ac_par[0]];
-        	        //float v = curr_cell.conc[rule.ac_par[1]];
-        	        float s = get_parameter(rule.ac_par[2], rule.ac_val[2], curr_id);
-        	        float a = get_parameter(rule.ac_par[3], rule.ac_val[3], curr_id);
-        	        float b = get_parameter(rule.ac_par[4], rule.ac_val[4], curr_id);
-
-        	        // reaction terms
-        	        next_cell.conc[rule.ac_par[0]] += s * (a * u - b) * dt;
-        		}
-        		else if (rule.action == REACT_CU) {
-        	        // current concentrations
-        	        float u = curr_cell.conc[rule.ac_par[0]];
-        	        //float v = curr_cell.conc[rule.ac_par[1]];
-        	        float s = get_parameter(rule.ac_par[2], rule.ac_val[2], curr_id);
-        	        float a = get_parameter(rule.ac_par[3], rule.ac_val[3], curr_id);
-        	        float b = get_parameter(rule.ac_par[4], rule.ac_val[4], curr_id);
-        	        float c = get_parameter(rule.ac_par[5], rule.ac_val[5], curr_id);
-
-        	        // reaction terms
-        	        next_cell.conc[rule.ac_par[0]] += s * (u - a) * (u - b) * (u - c) * dt;
-        		}
-        		else if (rule.action == CHANGE) {
-        			float val = get_parameter(rule.ac_par[1], rule.ac_val[1], curr_id);
-        			float dev = get_parameter(rule.ac_par[2], rule.ac_val[2], curr_id);
-        			if (rule.ac_par[0] < MAX_CHEMICALS) {
-        				// concentration
-        				next_cell.conc[rule.ac_par[0]] += deviate(val, dev);
-        			}
-        			else {
-        				// diffusion rate
-        				next_cell.diff[rule.ac_par[0] - MAX_CHEMICALS] += deviate(val, dev);
-
-        				// we check for negative diffusion only after a change action; there is no need to test after each iteration
-        				if (next_cell.diff[rule.ac_par[0] - MAX_CHEMICALS] < 0) {
-        					next_cell.diff[rule.ac_par[0] - MAX_CHEMICALS] = 0;
-        				}
-        			}
-        		}
-        		else if (rule.action == MAP) {
-        			float val = get_parameter(rule.ac_par[0], rule.ac_val[0], curr_id);
-        			float map;
-        			if (val < rule.ac_val[1]) {
-        				map = rule.ac_val[4];
-        			}
-        			else if (val > rule.ac_val[2]) {
-        				map = rule.ac_val[5];
-        			}
-        			else {
-        				// linearly interpolate 'val' into 'map'
-        				// TODO: part can be precomputed and stored in rule
-        				map = ((val - rule.ac_val[1]) / (rule.ac_val[2] - rule.ac_val[1])) * (rule.ac_val[5] - rule.ac_val[4]) + rule.ac_val[4];
-        			}
-        			simulation.curr_mappings[rule.ac_par[3] - 2 * MAX_CHEMICALS] = map;
-        		}
-        		else if (rule.action == POLARIZE) {
-        			polarity_source = rule.ac_par[0];
-        			next_cell.polarity_x = next_cell.polarity_y = 0;
-        		}
-        		else if (rule.action == DIVIDE) {
-        			if (simulation.division_limit == 0 || curr_cell.neighbors <= simulation.division_limit) {
-						float dir = get_parameter(rule.ac_par[0], rule.ac_val[0], curr_id);
-						float dev = get_parameter(rule.ac_par[1], rule.ac_val[1], curr_id);
-						CellId child_id = simulation.new_cell();
-						if (child_id != -1) {
-							divide_cell(curr_id, child_id, dir, dev);
-							n_divisions++;
-						}
-        			}
-        		}
-        		else if (rule.action == MOVE) {
-        			float val = get_parameter(rule.ac_par[0], rule.ac_val[0], curr_id);
-        			float dev = get_parameter(rule.ac_par[1], rule.ac_val[1], curr_id);
-        			float offset = deviate(val, dev);
-        			next_cell.x += curr_cell.polarity_x * offset;
-        			next_cell.y += curr_cell.polarity_y * offset;
-        		}
-        	}
-        }
+	// neighborhoods were computed from 'curr_cells' positions, so they stay valid while those do not change
+	if (neighbor_list && !cached) {
+		neighbor_list->build(simulation.curr_cells, n_cells);
+	}
+	watch.lap(PHASE_NEIGHBOR_LISTS);
 
-    	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t1);
-        //time_evaluate += (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) * 0.000001;
-
-        /*---------------- locate and interact with nearest neighbors ----------------*/
-
-        // get all neighbors within range
-        CellId *neighbor = nns->query_current_range(INFLUENCE_RANGE);
-        int n_neighbors = 0;
-
-    	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t2);
-        //time_nns_gather += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_nsec - t1.tv_nsec) * 0.000001;
-
-        // iterate through all neighbors
-        while ((*neighbor) != -1) {
-            const CellId neig_id = (*neighbor);
-            const Cell& neig_cell = simulation.curr_cells[neig_id];
-
-            float dx = neig_cell.x - curr_cell.x;
-            float dy = neig_cell.y - curr_cell.y;
-            float norm = sqrtf(dx * dx + dy * dy);
-
-        	// relocate a wrapped neighbor into a nearby position
-            if (norm > INFLUENCE_RANGE) {
-            	if (dx > INFLUENCE_RANGE) {
-            		dx = -2;
-            	}
-            	else if (dx < - INFLUENCE_RANGE) {
-            		dx = 2;
-            	}
-            	if (dy > INFLUENCE_RANGE) {
-            		dy = -2;
-            	}
-            	else if (dy < - INFLUENCE_RANGE) {
-            		dy = 2;
-            	}
-                norm = sqrtf(dx * dx + dy * dy);
-            }
-
-            // count cell neighbors
-            n_neighbors++;
-
-            /*---------------- account diffusion from neighbors --------------*/
-
-            for (int ch = 0; ch < n_chemicals; ch++) {
-            	if (simulation.chemicals[ch].anisotropic) {
-            		// anisotropic diffusion
-            		float px = curr_cell.polarity_x; // main direction vector -- must be normalized
-            		float py = curr_cell.polarity_y;
-            		float dot = 1;
-            		if (px != 0 || py != 0) {
-            			dot = fabs(dx * px + dy * py) / norm;
-            		}
-            		next_cell.conc[ch] += std::min(neig_cell.diff[ch], curr_cell.diff[ch]) * (neig_cell.conc[ch] - curr_cell.conc[ch]) * dt * dot;
-            	}
-            	else {
-            		// isotropic diffusion
-            		next_cell.conc[ch] += std::min(neig_cell.diff[ch], curr_cell.diff[ch]) * (neig_cell.conc[ch] - curr_cell.conc[ch]) * dt;
-
-            		// this check would prevent chemical production when using a negative diffusion rate, but it is too expensive
-            		// if ((neig_cell.diff[ch] < 0 || curr_cell.diff[ch] < 0) && (neig_cell.conc[ch] <= 0 || curr_cell.conc[ch] <= 0))
-            	    // { do not diffuse } else { diffuse normally }
-            	}
-            }
-
-            // define polarity for this cell, calculating gradient for reference chemical concentration
-            if (polarity_source != -1)
-            {
-            	next_cell.polarity_x += (neig_cell.conc[polarity_source] - curr_cell.conc[polarity_source]) * dx / norm;
-            	next_cell.polarity_y += (neig_cell.conc[polarity_source] - curr_cell.conc[polarity_source]) * dy / norm;
-
-            	// IDEA: to calculate vector pointing to inside of tissue; usable only for cells with 4 or less neighbors
-            	// next_cell.polarity_x += dx / norm;
-            	// next_cell.polarity_y += dy / norm;
-            }
-
-            // FIXME: this is a hack for finding nearest neighbors
-            if (neig_id == simulation.tracked_id) {
-            	next_cell.marker = true;
-            }
-
-            /*---------------- collision --------------*/
-
-            if (curr_cell.fixed == false) {
-				// VERY GOOD COLLISION: simpler, quick to stabilize and fewer holes
-				if (0 < norm && norm < 2) {
-					// NOTE: 2 is the sum of curr and neig radii
-					// NOTE: weight factor was 0.2 -> makes possible large concentrations of cells
-					// NOTE: the original collision code for distinct radii was
-					// float sr = curr_cell.r + neig_cell.r;
-					// float weight = 0.5 * curr_cell.r * (1 / norm) * (sr - norm) / sr;
-					// next_cell.x -= weight * dx;
-					// next_cell.y -= weight * dy;
-
-					next_cell.x -= (0.5 / norm - 0.25) * dx;
-					next_cell.y -= (0.5 / norm - 0.25) * dy;
-				}
-            }
-
-            // go to next neighbor
-            neighbor++;
-        }
-        next_cell.neighbors = n_neighbors;
+	// merge per-thread results in thread order, which is the same as the position order
+	statistics.start();
+	for (int t = 0; t < (int) context.thread_states.size(); t++) {
+		ThreadState& ts = context.thread_states[t];
+		statistics.merge(ts.statistics, n_chemicals);
+		if (profiler.enabled) {
+			double sampled = 0;
+			for (int p = PHASE_EVALUATE; p <= PHASE_CLAMP; p++) {
+				sampled += ts.times[p];
+			}
+			double scale = (sampled > 0) ? ts.times[PHASE_CELLS] / sampled : 0;
+			for (int p = PHASE_EVALUATE; p <= PHASE_CLAMP; p++) {
+				profiler.current[p] += ts.times[p] * scale;
+			}
+		}
 
-    	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t3);
-        //time_interact += (t3.tv_sec - t2.tv_sec) * 1000.0 + (t3.tv_nsec - t2.tv_nsec) * 0.000001;
+		for (int i = 0; i < (int) ts.divisions.size(); i++) {
+			CellId child_id = simulation.new_cell();
+			divide_cell(simulation, ts.divisions[i].parent_id, child_id, ts.divisions[i].direction);
+			n_divisions++;
+			if (neighbor_list) {
+				neighbor_list->insert(child_id, ts.divisions[i].parent_id, simulation.next_cells.x[child_id], simulation.next_cells.y[child_id]);
+			}
+		}
 
 #ifdef NNS_PRECISION
-        neighbor = exact->query_range(curr_id, INFLUENCE_RANGE);
-        int c = 0;
-        while ((*neighbor) != -1) {
-        	neighbor++;
-        	c++;
-        }
-    	next_cell.error = c - n_neighbors;
-        if (n_neighbors != c) {
-        	miss_cells++;
-        	miss_neighbors += c - n_neighbors;
-        	//std::cout << "cell=" << curr_id << " #ss=" << n_neighbors << " #exact=" << c << '\n';
-        }
-        total_neighbors += c;
+		miss_cells += ts.miss_cells;
+		miss_neighbors += ts.miss_neighbors;
+		total_neighbors += ts.total_neighbors;
 #endif // NNS_PRECISION
+	}
 
-        /*---------------- limit final position and concentrations --------------*/
-
-        if      (next_cell.x < simulation.domain_xmin) { next_cell.x = simulation.domain_xmin; }
-        else if (next_cell.x > simulation.domain_xmax) { next_cell.x = simulation.domain_xmax; }
-
-        if      (next_cell.y < simulation.domain_ymin) { next_cell.y = simulation.domain_ymin; }
-        else if (next_cell.y > simulation.domain_ymax) { next_cell.y = simulation.domain_ymax; }
-
-       	for (int ch = 0; ch < n_chemicals; ch++) {
-       		// clamping concentrations at zero is needed for Turing RD, or it would have numerical problems
-       		if      (next_cell.conc[ch] < 0)                              { next_cell.conc[ch] = 0; }
-       		else if (next_cell.conc[ch] > simulation.chemicals[ch].limit) { next_cell.conc[ch] = simulation.chemicals[ch].limit; }
-
-       		// diffusion does not need to be checked here, as it is only set by the experiment or altered by a change action
-       		// if (next_cell.diff[c] < 0) { next_cell.diff[c] = 0; }
-       	}
-
-        /*---------------- normalize polarity vector --------------*/
-
-       	if (polarity_source != -1)
-       	{
-       		float n = sqrtf(next_cell.polarity_x * next_cell.polarity_x + next_cell.polarity_y * next_cell.polarity_y);
-       		if (n > 0.0001) {
-       			next_cell.polarity_x /= n;
-       			next_cell.polarity_y /= n;
-       		}
-       		else {
-       			// previous polarity is now maintained in the absence of chemical gradient
-       			next_cell.polarity_x = curr_cell.polarity_x;
-       			next_cell.polarity_y = curr_cell.polarity_y;
-       			// NOTE: previously it was forced to zero
-       			// next_cell.polarity_x = next_cell.polarity_y = 0;
-       		}
-       	}
-
-       	// IDEA: when calculating vectors pointing to inside of tissue: cells with more than 4 neighbors should not polarize
-       	// if (n_neighbors > 4) {
-       	//	 next_cell.polarity_x = next_cell.polarity_y = 0;
-       	// }
-
-        /*---------------- store modified cell and update statistics --------------*/
-
-       	simulation.next_cells[curr_id] = next_cell;
-       	statistics.update(next_cell, n_chemicals);
-    }
-
-	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t2);
-    //time_calculate += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_nsec - t1.tv_nsec) * 0.000001;
+	watch.lap(PHASE_DIVISIONS);
 
     /*---------------- mirroring strategy #3 (average) --------------*/
 
@@ -796,27 +1170,27 @@ void simulation_single_step()
        		CellId primary_id   = simulation.mirror_list[i].first;
        		CellId secondary_id = simulation.mirror_list[i].second;
 
-       		Cell& primary_cell   = simulation.next_cells[primary_id];
-       		Cell& secondary_cell = simulation.next_cells[secondary_id];
+       		CellArray& cells = simulation.next_cells;
 
        	    // TODO: what should be done with polarity_x and polarity_y?
 
        		for (int c = 0; c < n_chemicals; c++) {
-       			float conc = (primary_cell.conc[c] + secondary_cell.conc[c]) / 2;
-       			float diff = (primary_cell.diff[c] + secondary_cell.diff[c]) / 2;
+       			float conc = (cells.conc[c][primary_id] + cells.conc[c][secondary_id]) / 2;
+       			float diff = (cells.diff[c][primary_id] + cells.diff[c][secondary_id]) / 2;
 
-       			primary_cell.conc[c] = secondary_cell.conc[c] = conc;
-       			primary_cell.diff[c] = secondary_cell.diff[c] = diff;
+       			cells.conc[c][primary_id] = cells.conc[c][secondary_id] = conc;
+       			cells.diff[c][primary_id] = cells.diff[c][secondary_id] = diff;
        		}
        	}
    	}
+    watch.lap(PHASE_MIRRORING);
 
     /*---------------- detect chemical stability --------------*/
 
     if (simulation.detect_stability /*&& simulation.iteration >= 999*/) { // prevent too early bail-out??
     	bool stable = true;
     	for (int i = 0; i < n_cells; i++) {
-    		if (fabs(simulation.next_cells[i].conc[0] - simulation.curr_cells[i].conc[0]) >= 0.0001) {
+    		if (fabs(simulation.next_cells.conc[0][i] - simulation.curr_cells.conc[0][i]) >= 0.0001) {
     			stable = false;
     			break;
     		}
@@ -824,26 +1198,27 @@ void simulation_single_step()
     	if (stable) {
     		//std::cout << "stop: stability reached at " << simulation.iteration << '\n';
     		//simulation.is_running = false;
-    		std::cout << "sim: stability reached at " << simulation.iteration << '\n';
+    		*context.log << "sim: stability reached at " << simulation.iteration << '\n';
     		simulation.is_stable = true;
     	}
     }
+    watch.lap(PHASE_STABILITY);
 
 #ifdef NNS_PRECISION
-    delete exact;
+    delete context.exact; context.exact = NULL;
     if (miss_cells) {
     	float error = 100.0 * miss_cells / n_cells;
     	if (simulation.iteration % 100 == 0) {
-    		std::cout << "#" << std::fixed << std::setw(5) << simulation.iteration
+    		*context.log << "#" << std::fixed << std::setw(5) << simulation.iteration
     				<< "  cell " << std::setprecision(0) << std::setw(3) << miss_cells
     				<< " / " << std::setprecision(3) << std::setw(5) << error << "% "
     				<< "  neig " << std::setprecision(0) << std::setw(3) << miss_neighbors
     				<< " / " << std::setprecision(3) << std::setw(5) << 100.0 * miss_neighbors / total_neighbors << "%\n";
     	}
-    	if (error > error_max) {
-    		error_max = error;
+    	if (error > context.error_max) {
+    		context.error_max = error;
     	}
-    	error_sum += error;
+    	context.error_sum += error;
     }
 #endif // NNS_PRECISION
 
@@ -858,21 +1233,32 @@ void simulation_single_step()
 
     // insert new cells created by division into NNS data structure and update statistics
     for (int k = n_cells; k < n_cells + n_divisions; k++) {
-    	nns->add_position(simulation.curr_cells[k].x, simulation.curr_cells[k].y, (CellId) k);
-       	statistics.update(simulation.curr_cells[k], n_chemicals);
+    	nns->add_position(simulation.curr_cells.x[k], simulation.curr_cells.y[k], (CellId) k);
+       	Cell cell;
+       	simulation.curr_cells.load((CellId) k, cell);
+       	statistics.update(cell, n_chemicals);
     }
     statistics.finish(n_cells + n_divisions);
+    watch.lap(PHASE_NNS_UPDATE);
+
+    // keep memory order close to spatial order as cells divide and move
+    if (context.reorder && simulation.iteration % REORDER_INTERVAL == 0 && get_locality(simulation) > REORDER_FACTOR * context.reorder_locality) {
+    	reorder_cells(context);
+    }
+    watch.lap(PHASE_REORDER);
 
-	//clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
-    //time_total += (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) * 0.000001;
+    if (profiler.enabled) {
+    	profiler.finish_iteration();
+    }
 }
 
-void simulation_run(int steps)
+void simulation_run(SimulationContext& context, int steps)
 {
+	Simulation& simulation = context.simulation;
 	for (int i = 0; i < steps; i++) {
-		simulation_single_step();
+		simulation_single_step(context);
 		if (simulation.iteration == simulation.stop_at) {
-			std::cout << "sim: stopped at " << simulation.iteration << "\n";
+			*context.log << "sim: stopped at " << simulation.iteration << "\n";
 			simulation.is_running = false;
 			break;
 		} else if (simulation.detect_stability && simulation.is_stable) {
@@ -881,32 +1267,161 @@ void simulation_run(int steps)
 	}
 }
 
-void simulation_done()
+void simulation_done(SimulationContext& context)
 {
-	delete nns; nns = NULL;
-
-	//float other = time_total - time_nns_setup - time_evaluate - time_nns_gather - time_interact;
-    //float other = time_total - time_nns_setup - time_calculate;
-
-	//printf("\n");
-	//printf("nns setup   %8.1f ms   %4.1f%%\n", time_nns_setup,  100 * time_nns_setup  / time_total);
-	//printf("evaluate    %8.1f ms   %4.1f%%\n", time_evaluate,   100 * time_evaluate   / time_total);
-	//printf("nns gather  %8.1f ms   %4.1f%%\n", time_nns_gather, 100 * time_nns_gather / time_total);
-	//printf("interact    %8.1f ms   %4.1f%%\n", time_interact,   100 * time_interact   / time_total);
-	//printf("calculate   %8.1f ms   %4.1f%%\n", time_calculate,  100 * time_calculate  / time_total);
-	//printf("other       %8.1f ms   %4.1f%%\n", other,           100 * other           / time_total);
-	//printf("total       %8.1f ms  100.0%%  iter=%d\n", time_total, simulation.iteration);
+	Simulation& simulation = context.simulation;
+	NeighborList *neighbor_list = context.neighbor_list;
+	NNS *nns = context.nns;
+	std::ostream& log = *context.log;
+
+	// memory taken by the cells and their neighborhoods, not the capacity reserved for further growth
+	size_t cells_memory = simulation.curr_cells.get_used_memory(simulation.n_cells) + simulation.next_cells.get_used_memory(simulation.n_cells);
+	size_t nns_memory = nns ? nns->get_used_memory() : 0;
+	size_t list_memory = neighbor_list ? neighbor_list->get_used_memory() : 0;
+	log << "sim: " << simulation.n_cells << " cells, memory used " << (cells_memory + nns_memory + list_memory) / 1024 << " kB"
+			<< " (cells " << cells_memory / 1024 << " kB, nns " << nns_memory / 1024 << " kB, neighbor lists " << list_memory / 1024 << " kB)\n";
+
+	if (neighbor_list && !neighbor_list->has_geometry()) {
+		log << "sim: verlet lists built " << neighbor_list->get_build_count() << " times, " << neighbor_list->get_insert_count()
+				<< " cells inserted without a rebuild\n";
+	}
 
-	//printf("iter/s  %7.0f\n", simulation.iteration / (time_sort + time_calc));
-	//printf("iter/s  %8.1f\n", 1000 * simulation.iteration / time_total);
-    //printf("\n");
+	delete nns; context.nns = NULL;
+	delete context.workers; context.workers = NULL;
+	delete neighbor_list; context.neighbor_list = NULL;
+	context.thread_states.clear();
 
+	if (context.profiler.enabled) {
+		context.profiler.report(log, context.profile_format, simulation.n_cells, simulation.n_threads);
+	}
 
 #ifdef NNS_PRECISION
-	std::cout << '\n';
-	std::cout << "cells "      << simulation.n_cells << '\n';
-	std::cout << "max error "  << std::setprecision(3) << error_max << "%\n";
-	std::cout << "mean error " << std::setprecision(3) << error_sum / simulation.iteration << "%\n";
-	std::cout << "zoom level " << std::setprecision(4) << simulation.zoom_level << '\n';
+	log << '\n';
+	log << "cells "      << simulation.n_cells << '\n';
+	log << "max error "  << std::setprecision(3) << context.error_max << "%\n";
+	log << "mean error " << std::setprecision(3) << context.error_sum / simulation.iteration << "%\n";
+	log << "zoom level " << std::setprecision(4) << simulation.zoom_level << '\n';
 #endif // NNS_PRECISION
 }
+
+/*-------------------------------- DEFAULT CONTEXT FUNCTIONS --------------------------------*/
+
+int simulation_define_chemical(std::string name, float limit, bool anisotropic)
+{
+	return simulation_define_chemical(default_context, name, limit, anisotropic);
+}
+
+void simulation_define_division_limit(int division_limit)
+{
+	simulation_define_division_limit(default_context, division_limit);
+}
+
+void simulation_define_domain(float width, float height)
+{
+	simulation_define_domain(default_context, width, height);
+}
+
+void simulation_define_time_step(float time_step)
+{
+	simulation_define_time_step(default_context, time_step);
+}
+
+void simulation_define_mirror_pair(CellId id1, CellId id2)
+{
+	simulation_define_mirror_pair(default_context, id1, id2);
+}
+
+void simulation_use_chemical_concentration(int chemical, float value, float deviation)
+{
+	simulation_use_chemical_concentration(default_context, chemical, value, deviation);
+}
+
+void simulation_use_chemical_diffusion(int chemical, float value, float deviation)
+{
+	simulation_use_chemical_diffusion(default_context, chemical, value, deviation);
+}
+
+void simulation_use_polarity(float angle, float deviation)
+{
+	simulation_use_polarity(default_context, angle, deviation);
+}
+
+void simulation_use_profiler(ProfileFormat format)
+{
+	simulation_use_profiler(default_context, format);
+}
+
+void simulation_use_seed(int seed)
+{
+	simulation_use_seed(default_context, seed);
+}
+
+CellId simulation_create_cell(float x, float y, bool fixed)
+{
+	return simulation_create_cell(default_context, x, y, fixed);
+}
+
+void simulation_create_square_grid(int count_x, int count_y, float center_x, float center_y, float dev, bool fixed, bool wrap)
+{
+	simulation_create_square_grid(default_context, count_x, count_y, center_x, center_y, dev, fixed, wrap);
+}
+
+void simulation_create_square_circle(int count, float center_x, float center_y, float dev, bool fixed)
+{
+	simulation_create_square_circle(default_context, count, center_x, center_y, dev, fixed);
+}
+
+void simulation_create_hexagonal_grid(int count_x, int count_y, float center_x, float center_y, float dev, bool fixed)
+{
+	simulation_create_hexagonal_grid(default_context, count_x, count_y, center_x, center_y, dev, fixed);
+}
+
+void simulation_create_hexagonal_circle(int count, float center_x, float center_y, float dev, bool fixed)
+{
+	simulation_create_hexagonal_circle(default_context, count, center_x, center_y, dev, fixed);
+}
+
+void simulation_set_cell_concentration(CellId id, int chemical, float value, float deviation)
+{
+	simulation_set_cell_concentration(default_context, id, chemical, value, deviation);
+}
+
+void simulation_set_cell_diffusion(CellId id, int chemical, float value, float deviation)
+{
+	simulation_set_cell_diffusion(default_context, id, chemical, value, deviation);
+}
+
+void simulation_set_cell_polarity(CellId id, float angle, float deviation)
+{
+	simulation_set_cell_polarity(default_context, id, angle, deviation);
+}
+
+void simulation_set_cell_fixed(CellId id, bool fixed)
+{
+	simulation_set_cell_fixed(default_context, id, fixed);
+}
+
+void simulation_add_rule(const Rule& rule)
+{
+	simulation_add_rule(default_context, rule);
+}
+
+void simulation_init(NNSChoice nns_choice, bool detect_stability, int n_threads, CacheChoice cache_choice, float verlet_skin, bool reorder_cells_by_position)
+{
+	simulation_init(default_context, nns_choice, detect_stability, n_threads, cache_choice, verlet_skin, reorder_cells_by_position);
+}
+
+void simulation_run(int steps)
+{
+	simulation_run(default_context, steps);
+}
+
+void simulation_done()
+{
+	simulation_done(default_context);
+}
+
+const Profiler& simulation_get_profiler()
+{
+	return default_context.profiler;
+}
@@ -3,14 +3,123 @@
 
 /*-------------------------------- INCLUDES --------------------------------*/
 
+#include <ostream>
+#include <vector>
+
+#include "compiler.hpp"
 #include "nns_base.hpp"
+#include "profiler.hpp"
+
+class NeighborList;
+class WorkerPool;
 
 /*-------------------------------- TYPE DEFINITIONS --------------------------------*/
 
-enum NNSChoice {AUTO, SPATIAL_SORTING, KD_TREE};
+enum NNSChoice {AUTO, SPATIAL_SORTING, KD_TREE, CELL_LIST};
+enum CacheChoice {CACHE_AUTO, CACHE_OFF, CACHE_STATIC, CACHE_VERLET};
+
+// attributes given to cells created from now on, see simulation_use_*
+struct CellParameters {
+	float polarity;
+	float polarity_dev;
+	float chem_conc[MAX_CHEMICALS];
+	float chem_conc_dev[MAX_CHEMICALS];
+	float chem_diff[MAX_CHEMICALS];
+	float chem_diff_dev[MAX_CHEMICALS];
+
+	CellParameters () {
+		polarity = FLT_MAX; // none
+		polarity_dev = 0;
+		for (int i = 0; i < MAX_CHEMICALS; i++) {
+			chem_conc[i] = 0;
+			chem_conc_dev[i] = 0;
+			chem_diff[i] = 0;
+			chem_diff_dev[i] = 0;
+		}
+	}
+};
+
+// division requested by a cell, carried out only after all threads have finished the current step
+struct Division {
+	CellId parent_id;
+	float  direction; // final direction in degrees, relative to parent polarity
+};
+
+// state private to each thread during a simulation step
+struct ThreadState {
+	int        thread;
+	Statistics statistics;
+	std::vector<float> registers; // operands of compiled rules, see compiler.hpp
+	CellId     neighbors[MAX_NEIGHBORS + 1];
+	float      dx[MAX_NEIGHBORS], dy[MAX_NEIGHBORS], norm[MAX_NEIGHBORS]; // neighborhood geometry when not cached
+	float      weights[MAX_NEIGHBORS]; // anisotropic diffusion weights
+	std::vector<Division> divisions;
+	double     times[N_PHASES]; // profiled time of per-cell phases
+#ifdef NNS_PRECISION
+	int miss_cells, miss_neighbors, total_neighbors;
+#endif // NNS_PRECISION
+};
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// generator of the C library (the additive feedback generator of glibc behind rand() and srand()), with its state
+// held in the object, so that each context sets up its cells from its own sequence
+class Random {
+private:
+	int state[31];
+	int front, rear;
+
+public:
+	Random(unsigned int seed = 1) { set_seed(seed); }
+
+	void set_seed(unsigned int seed);
+	int  next(); // in [0, RAND_MAX]
+};
+
+// complete state of one simulation; contexts are independent, so several of them can run at the same time
+// NOTE: copies are meant to be made after setting up and before simulation_init, as NNS, workers and neighbor lists
+// are owned by the context that created them
+class SimulationContext {
+public:
+	Simulation    simulation;
+	Statistics    statistics;
+	NNS          *nns;
+	std::ostream *log; // destination of informative messages
+	Random        random; // draws initial values while setting up
+
+	// managed by simulation.cpp
+	CellParameters cell_parameters;
+	bool any_anisotropic;
+	int  nns_dim_x, nns_dim_y;
+	bool nns_wrap;
+
+	WorkerPool  *workers;
+	std::vector<ThreadState> thread_states;
+	NeighborList *neighbor_list; // NULL when neighborhoods are not cached
+	Program      program;
+
+	Profiler      profiler;
+	ProfileFormat profile_format;
+
+	bool  reorder;
+	float reorder_locality; // locality right after the last reorder
+
+	std::vector<CellId> nns_order; // order of positions to restore in the NNS, see checkpoint.hpp
+
+#ifdef NNS_PRECISION
+	NNS  *exact;
+	float error_max;
+	float error_sum;
+#endif // NNS_PRECISION
+
+public:
+	SimulationContext();
+};
 
 /*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
 
+// setup and simulation of the default context, as used by the pattern language and the programs
+
 int simulation_define_chemical(std::string name, float limit = FLT_MAX, bool anisotropic = false);
 
 void simulation_define_division_limit(int division_limit);
@@ -22,6 +131,7 @@ void simulation_define_mirror_pair(CellId id1, CellId id2);
 void simulation_use_chemical_concentration(int chemical, float value, float deviation = 0);
 void simulation_use_chemical_diffusion(int chemical, float value, float deviation = 0);
 void simulation_use_polarity(float angle, float deviation = 0);
+void simulation_use_profiler(ProfileFormat format = PROFILE_TABLE);
 void simulation_use_seed(int seed);
 
 CellId simulation_create_cell(float x, float y, bool fixed = false);
@@ -38,15 +148,55 @@ void simulation_set_cell_fixed(CellId id, bool fixed);
 
 void simulation_add_rule(const Rule& rule);
 
-void simulation_init(NNSChoice nns_choice = AUTO, bool detect_stability = false);
+void simulation_init(NNSChoice nns_choice = AUTO, bool detect_stability = false, int n_threads = 1, CacheChoice cache_choice = CACHE_AUTO, float verlet_skin = 1, bool reorder_cells_by_position = false);
 void simulation_run(int steps);
 void simulation_done();
 
+// the same functions on a given context; they do not touch any global state, so different contexts can be set up and
+// run from different threads
+
+int simulation_define_chemical(SimulationContext& context, std::string name, float limit = FLT_MAX, bool anisotropic = false);
+
+void simulation_define_division_limit(SimulationContext& context, int division_limit);
+void simulation_define_domain(SimulationContext& context, float width, float height);
+void simulation_define_time_step(SimulationContext& context, float time_step);
+
+void simulation_define_mirror_pair(SimulationContext& context, CellId id1, CellId id2);
+
+void simulation_use_chemical_concentration(SimulationContext& context, int chemical, float value, float deviation = 0);
+void simulation_use_chemical_diffusion(SimulationContext& context, int chemical, float value, float deviation = 0);
+void simulation_use_polarity(SimulationContext& context, float angle, float deviation = 0);
+void simulation_use_profiler(SimulationContext& context, ProfileFormat format = PROFILE_TABLE);
+void simulation_use_seed(SimulationContext& context, int seed);
+
+CellId simulation_create_cell(SimulationContext& context, float x, float y, bool fixed = false);
+
+void simulation_create_square_grid(SimulationContext& context, int count_x, int count_y, float center_x = 0, float center_y = 0, float dev = 0, bool fixed = false, bool wrap = false);
+void simulation_create_square_circle(SimulationContext& context, int count, float center_x = 0, float center_y = 0, float dev = 0, bool fixed = false);
+void simulation_create_hexagonal_grid(SimulationContext& context, int count_x, int count_y, float center_x = 0, float center_y = 0, float dev = 0, bool fixed = false);
+void simulation_create_hexagonal_circle(SimulationContext& context, int count, float center_x = 0, float center_y = 0, float dev = 0, bool fixed = false);
+
+void simulation_set_cell_concentration(SimulationContext& context, CellId id, int chemical, float value, float deviation = 0);
+void simulation_set_cell_diffusion(SimulationContext& context, CellId id, int chemical, float value, float deviation = 0);
+void simulation_set_cell_polarity(SimulationContext& context, CellId id, float angle, float deviation = 0);
+void simulation_set_cell_fixed(SimulationContext& context, CellId id, bool fixed);
+
+void simulation_add_rule(SimulationContext& context, const Rule& rule);
+
+void simulation_init(SimulationContext& context, NNSChoice nns_choice = AUTO, bool detect_stability = false, int n_threads = 1, CacheChoice cache_choice = CACHE_AUTO, float verlet_skin = 1, bool reorder_cells_by_position = false);
+void simulation_run(SimulationContext& context, int steps);
+void simulation_done(SimulationContext& context);
+
+const Profiler& simulation_get_profiler();
+
 /*-------------------------------- EXPORTED VARIABLES --------------------------------*/
 
-extern NNS *nns;
-extern Simulation simulation;
-extern Statistics statistics;
+// context of the functions above that do not take one; the variables below refer to its members
+extern SimulationContext default_context;
+
+extern NNS *&nns;
+extern Simulation& simulation;
+extern Statistics& statistics;
 
 //extern struct timespec time_start;
 //extern float time_init, time_sort, time_calc, time_draw;
@@ -0,0 +1,237 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "sweep.hpp"
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+// rule parameters that can be swept, by the words used in pattern files
+struct ParameterName {
+	Action      action;
+	const char *name;
+	int         index;
+};
+
+/*-------------------------------- LOCAL VARIABLES --------------------------------*/
+
+static const ParameterName parameter_names[] = {
+	{REACT_GS, "scale", 2}, {REACT_GS, "f", 3},     {REACT_GS, "k", 4},
+	{REACT_TU, "scale", 2}, {REACT_TU, "alpha", 3}, {REACT_TU, "beta", 4},
+	{REACT_LI, "scale", 2}, {REACT_LI, "a", 3},     {REACT_LI, "b", 4},
+	{REACT_CU, "scale", 2}, {REACT_CU, "a", 3},     {REACT_CU, "b", 4}, {REACT_CU, "c", 5},
+	{CHANGE,   "value", 1}, {CHANGE,   "dev", 2},
+	{DIVIDE,   "direction", 0}, {DIVIDE, "dev", 1},
+	{MOVE,     "value", 0}, {MOVE,     "dev", 1}
+};
+
+static const int N_PARAMETER_NAMES = sizeof(parameter_names) / sizeof(parameter_names[0]);
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+static void error(std::string message, int line_num = 0)
+{
+	std::cerr << "error: " + message;
+	if (line_num) {
+		std::cerr << " in line " << line_num << '\n';
+	}
+	else {
+		std::cerr << '\n';
+	}
+	exit(1);
+}
+
+static int find_chemical(const Simulation& simulation, std::string name)
+{
+	for (int ch = 0; ch < simulation.n_chemicals; ch++) {
+		if (simulation.chemicals[ch].name == name) {
+			return ch;
+		}
+	}
+	return -1;
+}
+
+// either a list of values or 'from A to B step S', with B included
+static void get_values(std::stringstream& ss, std::vector<float>& values, int line_num)
+{
+	std::string word;
+	if (!(ss >> word)) {
+		error("values expected", line_num);
+	}
+	if (word == "from") {
+		float from, to, step;
+		std::string to_word, step_word;
+		if (!(ss >> from >> to_word >> to >> step_word >> step) || to_word != "to" || step_word != "step") {
+			error("expected 'from A to B step S'", line_num);
+		}
+		if (step <= 0 || to < from) {
+			error("empty range", line_num);
+		}
+		// small tolerance, so that B is not lost to rounding
+		int n = int(floorf((to - from) / step + 0.001f)) + 1;
+		for (int i = 0; i < n; i++) {
+			values.push_back(from + i * step);
+		}
+		return;
+	}
+	do {
+		char *end;
+		float value = strtod(word.c_str(), &end);
+		if (*end != '\0') {
+			error("value expected instead of " + word, line_num);
+		}
+		values.push_back(value);
+	} while (ss >> word);
+}
+
+/*-------------------------------- SWEEP METHODS --------------------------------*/
+
+int Sweep::get_run_count() const
+{
+	int count = 1;
+	for (int a = 0; a < (int) axes.size(); a++) {
+		count *= (int) axes[a].values.size();
+	}
+	return count;
+}
+
+float Sweep::get_value(int run, int axis) const
+{
+	for (int a = 0; a < axis; a++) {
+		run /= (int) axes[a].values.size();
+	}
+	return axes[axis].values[run % axes[axis].values.size()];
+}
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+void sweep_load(Sweep& sweep, const SimulationContext& context, const char *name)
+{
+	const Simulation& simulation = context.simulation;
+
+	std::ifstream file(name);
+	if (! file.is_open()) {
+		error("cannot open sweep file '" + std::string(name) + "'");
+	}
+
+	int n = 0;
+	std::string line, word;
+	while (std::getline(file, line)) {
+		n++;
+
+		std::stringstream ss(line);
+		if (!(ss >> word) || (word[0] == '/' && word[1] == '/')) {
+			// skip comments and blank lines
+			continue;
+		}
+
+		if (word == "rule") {
+			// rules are numbered from 1, in the order of the pattern file
+			int r;
+			if (!(ss >> r) || r < 1 || r > (int) simulation.rules.size()) {
+				error("unknown rule number", n);
+			}
+			const Rule& rule = simulation.rules[r - 1];
+			std::ostringstream number;
+			number << r;
+			ss >> word;
+
+			SweepAxis axis;
+			axis.name = "rule" + number.str() + "." + word;
+			axis.rule = r - 1;
+			axis.chemical = -1;
+			if (word == "probability") {
+				if (rule.predicate != PROBABILITY) {
+					error("rule " + number.str() + " has no probability", n);
+				}
+				axis.target = SWEEP_PREDICATE;
+				axis.parameter = 0;
+				if (rule.pr_par[0] != CONSTANT) {
+					error("probability of rule " + number.str() + " is not a constant", n);
+				}
+			}
+			else {
+				axis.target = SWEEP_RULE;
+				axis.parameter = -1;
+				for (int i = 0; i < N_PARAMETER_NAMES; i++) {
+					if (parameter_names[i].action == rule.action && word == parameter_names[i].name) {
+						axis.parameter = parameter_names[i].index;
+					}
+				}
+				if (axis.parameter == -1) {
+					error("rule " + number.str() + " has no parameter " + word, n);
+				}
+				if (rule.ac_par[axis.parameter] != CONSTANT) {
+					error("parameter " + word + " of rule " + number.str() + " is not a constant", n);
+				}
+			}
+			get_values(ss, axis.values, n);
+			sweep.axes.push_back(axis);
+		}
+		else if (word == "chemical") {
+			ss >> word;
+			SweepAxis axis;
+			axis.target = SWEEP_DIFFUSION;
+			axis.rule = axis.parameter = -1;
+			axis.chemical = find_chemical(simulation, word);
+			if (axis.chemical == -1) {
+				error("unknown chemical " + word, n);
+			}
+			axis.name = word + ".diff";
+			ss >> word;
+			if (word != "diff") {
+				error("only 'diff' can be swept for a chemical", n);
+			}
+			get_values(ss, axis.values, n);
+			sweep.axes.push_back(axis);
+		}
+		else if (word == "texture") {
+			ss >> word;
+			sweep.texture_chemical = find_chemical(simulation, word);
+			if (sweep.texture_chemical == -1) {
+				error("unknown chemical " + word, n);
+			}
+		}
+		else if (word == "csv") {
+			if (!(ss >> sweep.csv_name)) {
+				error("file name expected", n);
+			}
+		}
+		else {
+			error("unknown command " + word, n);
+		}
+	}
+	if (sweep.axes.empty()) {
+		error("nothing to sweep in '" + std::string(name) + "'");
+	}
+}
+
+void sweep_apply(const Sweep& sweep, int run, SimulationContext& context)
+{
+	Simulation& simulation = context.simulation;
+
+	for (int a = 0; a < (int) sweep.axes.size(); a++) {
+		const SweepAxis& axis = sweep.axes[a];
+		float value = sweep.get_value(run, a);
+		switch (axis.target) {
+		case SWEEP_RULE:
+			simulation.rules[axis.rule].ac_val[axis.parameter] = value;
+			break;
+		case SWEEP_PREDICATE:
+			simulation.rules[axis.rule].pr_val[axis.parameter] = value;
+			break;
+		case SWEEP_DIFFUSION:
+			// replaces the diffusion rate given by 'use chemical ... diff' to every cell
+			for (int id = 0; id < simulation.n_cells; id++) {
+				simulation.curr_cells.diff[axis.chemical][id] = value;
+			}
+			context.cell_parameters.chem_diff[axis.chemical] = value;
+			context.cell_parameters.chem_diff_dev[axis.chemical] = 0;
+			break;
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <string>
+#include <vector>
+
+#include "simulation.hpp"
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+enum SweepTarget {SWEEP_RULE, SWEEP_PREDICATE, SWEEP_DIFFUSION};
+
+// one swept quantity and the values it takes
+struct SweepAxis {
+	std::string name; // as in the summary, e.g. "rule1.alpha" or "U.diff"
+	SweepTarget target;
+	int rule;         // for SWEEP_RULE and SWEEP_PREDICATE
+	int parameter;    // index into ac_val or pr_val of the rule
+	int chemical;     // for SWEEP_DIFFUSION
+	std::vector<float> values;
+};
+
+// runs are all combinations of the values of the axes; run 0 takes the first value of every axis, and the first
+// axis changes fastest
+class Sweep {
+public:
+	std::vector<SweepAxis> axes;
+	std::string csv_name;
+	int texture_chemical; // -1 for no texture
+
+public:
+	Sweep()
+	{
+		csv_name = "sweep.csv";
+		texture_chemical = -1;
+	}
+
+	int get_run_count() const;
+	float get_value(int run, int axis) const;
+};
+
+/*-------------------------------- EXPORTED FUNCTIONS --------------------------------*/
+
+// reads the sweep file 'name'; rules and chemicals it refers to are looked up in 'context', which must be set up
+void sweep_load(Sweep& sweep, const SimulationContext& context, const char *name);
+
+// sets the values of run 'run' in 'context', which must not be initialized yet
+void sweep_apply(const Sweep& sweep, int run, SimulationContext& context);
+
+#endif // SWEEP_HPP
@@ -0,0 +1,263 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "trajectory.hpp"
+
+/*-------------------------------- LOCAL VARIABLES --------------------------------*/
+
+static const char zeros[TRAJECTORY_ALIGNMENT] = {0};
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+static long long align(long long size)
+{
+	return (size + TRAJECTORY_ALIGNMENT - 1) / TRAJECTORY_ALIGNMENT * TRAJECTORY_ALIGNMENT;
+}
+
+// size of each array of a frame, padding included
+static long long array_size(int n_cells)
+{
+	return align((long long) n_cells * 4);
+}
+
+static long long frame_size(int n_cells, int n_chemicals)
+{
+	return sizeof(TrajectoryFrameHeader) + (5 + n_chemicals) * array_size(n_cells);
+}
+
+// writes all of 'iov', resuming after short writes
+static bool write_all(int fd, struct iovec *iov, int n)
+{
+	while (n > 0) {
+		ssize_t written = writev(fd, iov, n);
+		if (written < 0) {
+			return false;
+		}
+		while (n > 0 && (size_t) written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++; n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char*) iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+// adds an array and its padding to 'iov'
+static int add_array(struct iovec *iov, int n, const void *values, int n_cells)
+{
+	size_t size = (size_t) n_cells * 4;
+	iov[n].iov_base = (void*) values;
+	iov[n].iov_len = size;
+	n++;
+	if (array_size(n_cells) > (long long) size) {
+		iov[n].iov_base = (void*) zeros;
+		iov[n].iov_len = array_size(n_cells) - size;
+		n++;
+	}
+	return n;
+}
+
+/*-------------------------------- TRAJECTORY WRITER METHODS --------------------------------*/
+
+TrajectoryWriter::TrajectoryWriter()
+{
+	fd = -1;
+	every = 1;
+	n_chemicals = 0;
+	offset = 0;
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+	close();
+}
+
+bool TrajectoryWriter::open(const char *filename, const Simulation& simulation, int every)
+{
+	fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		return false;
+	}
+	this->every = (every < 1) ? 1 : every;
+	n_chemicals = simulation.n_chemicals;
+	index.clear();
+
+	TrajectoryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+	header.version = TRAJECTORY_VERSION;
+	header.every = this->every;
+	header.n_chemicals = n_chemicals;
+	for (int ch = 0; ch < n_chemicals; ch++) {
+		strncpy(header.chemicals[ch], simulation.chemicals[ch].name.c_str(), sizeof(header.chemicals[ch]) - 1);
+	}
+
+	struct iovec iov = {&header, sizeof(header)};
+	offset = sizeof(header);
+	return write_all(fd, &iov, 1);
+}
+
+bool TrajectoryWriter::record(const Simulation& simulation)
+{
+	if (fd == -1 || simulation.iteration % every != 0) {
+		return fd != -1;
+	}
+	const CellArray& cells = simulation.curr_cells;
+	int n_cells = simulation.n_cells;
+
+	TrajectoryFrameHeader frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.iteration = simulation.iteration;
+	frame.n_cells = n_cells;
+	frame.size = frame_size(n_cells, n_chemicals);
+
+	struct iovec iov[1 + 2 * (5 + MAX_CHEMICALS)];
+	iov[0].iov_base = &frame;
+	iov[0].iov_len = sizeof(frame);
+	int n = 1;
+	n = add_array(iov, n, cells.x, n_cells);
+	n = add_array(iov, n, cells.y, n_cells);
+	n = add_array(iov, n, cells.polarity_x, n_cells);
+	n = add_array(iov, n, cells.polarity_y, n_cells);
+	n = add_array(iov, n, cells.birth, n_cells);
+	for (int ch = 0; ch < n_chemicals; ch++) {
+		n = add_array(iov, n, cells.conc[ch], n_cells);
+	}
+	if (!write_all(fd, iov, n)) {
+		return false;
+	}
+
+	TrajectoryIndexEntry entry;
+	entry.offset = offset;
+	entry.iteration = frame.iteration;
+	entry.n_cells = n_cells;
+	index.push_back(entry);
+	offset += frame.size;
+	return true;
+}
+
+bool TrajectoryWriter::close()
+{
+	if (fd == -1) {
+		return true;
+	}
+
+	TrajectoryHeader header;
+	bool ok = (pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header));
+	header.n_frames = (int) index.size();
+	header.index_offset = offset;
+
+	struct iovec iov = {index.data(), index.size() * sizeof(TrajectoryIndexEntry)};
+	ok = ok && write_all(fd, &iov, 1);
+	ok = ok && (pwrite(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header));
+	ok = (::close(fd) == 0) && ok;
+	fd = -1;
+	return ok;
+}
+
+/*-------------------------------- TRAJECTORY READER METHODS --------------------------------*/
+
+TrajectoryReader::TrajectoryReader()
+{
+	data = NULL;
+	size = 0;
+}
+
+TrajectoryReader::~TrajectoryReader()
+{
+	close();
+}
+
+bool TrajectoryReader::open(const char *filename)
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(TrajectoryHeader)) {
+		::close(fd);
+		return false;
+	}
+	void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	data = (const char*) mapped;
+	size = st.st_size;
+
+	const TrajectoryHeader& header = get_header();
+	if (memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 || header.version != TRAJECTORY_VERSION ||
+			header.n_chemicals < 0 || header.n_chemicals > MAX_CHEMICALS) {
+		close();
+		return false;
+	}
+
+	// take the index of a closed file, or rebuild it from the complete frames of an interrupted recording
+	long long index_end = header.index_offset + (long long) header.n_frames * sizeof(TrajectoryIndexEntry);
+	if (header.index_offset > 0 && index_end <= (long long) size) {
+		const TrajectoryIndexEntry *entries = (const TrajectoryIndexEntry*) (data + header.index_offset);
+		index.assign(entries, entries + header.n_frames);
+		return true;
+	}
+	long long offset = sizeof(TrajectoryHeader);
+	while (offset + (long long) sizeof(TrajectoryFrameHeader) <= (long long) size) {
+		const TrajectoryFrameHeader *frame = (const TrajectoryFrameHeader*) (data + offset);
+		if (frame->n_cells < 0 || frame->size != frame_size(frame->n_cells, header.n_chemicals) || offset + frame->size > (long long) size) {
+			break;
+		}
+		TrajectoryIndexEntry entry;
+		entry.offset = offset;
+		entry.iteration = frame->iteration;
+		entry.n_cells = frame->n_cells;
+		index.push_back(entry);
+		offset += frame->size;
+	}
+	return true;
+}
+
+void TrajectoryReader::close()
+{
+	if (data) {
+		munmap((void*) data, size);
+	}
+	data = NULL;
+	size = 0;
+	index.clear();
+}
+
+void TrajectoryReader::get_frame(int f, TrajectoryFrame& frame) const
+{
+	const TrajectoryIndexEntry& entry = index[f];
+	long long step = array_size(entry.n_cells);
+	const char *p = data + entry.offset + sizeof(TrajectoryFrameHeader);
+
+	frame.iteration = entry.iteration;
+	frame.n_cells = entry.n_cells;
+	frame.x = (const float*) p; p += step;
+	frame.y = (const float*) p; p += step;
+	frame.polarity_x = (const float*) p; p += step;
+	frame.polarity_y = (const float*) p; p += step;
+	frame.birth = (const int*) p; p += step;
+	for (int ch = 0; ch < MAX_CHEMICALS; ch++) {
+		if (ch < get_header().n_chemicals) {
+			frame.conc[ch] = (const float*) p; p += step;
+		}
+		else {
+			frame.conc[ch] = NULL;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cstddef>
+#include <vector>
+
+#include "types.hpp"
+
+/*-------------------------------- MACRO DEFINITIONS --------------------------------*/
+
+#define TRAJECTORY_MAGIC     "PEXTRAJ"
+#define TRAJECTORY_VERSION   1
+#define TRAJECTORY_ALIGNMENT 64 // of frames and of the arrays in them, so they can be used in place once mapped
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+// a trajectory file holds a header, the frames one after the other, and an index of the frames at the end; all
+// values are in the byte order of the machine that recorded them
+//
+// a frame is a frame header followed by the arrays of its 'n_cells' cells, in this order: x, y, polarity_x,
+// polarity_y (float), birth (int) and the concentration of each chemical (float); each array starts at a multiple of
+// TRAJECTORY_ALIGNMENT from the frame start
+//
+// the index is written when the file is closed; without it (the recording was interrupted), frames can still be
+// found one after the other from their 'size'
+
+struct TrajectoryHeader {
+	char magic[8];
+	int  version;
+	int  every;       // iterations between frames
+	int  n_chemicals;
+	int  n_frames;    // 0 until the file is closed
+	long long index_offset; // 0 until the file is closed
+	char chemicals[MAX_CHEMICALS][16]; // names, truncated
+};
+
+struct TrajectoryFrameHeader {
+	int  iteration;
+	int  n_cells;
+	long long size;   // of the whole frame, header included
+	char padding[TRAJECTORY_ALIGNMENT - 16];
+};
+
+struct TrajectoryIndexEntry {
+	long long offset; // from the start of the file
+	int  iteration;
+	int  n_cells;
+};
+
+// arrays of one frame, pointing into the mapped file
+struct TrajectoryFrame {
+	int iteration;
+	int n_cells;
+	const float *x, *y;
+	const float *polarity_x, *polarity_y;
+	const int   *birth;
+	const float *conc[MAX_CHEMICALS];
+};
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// appends frames to a trajectory file; each frame is written straight from the cell arrays, with a single system call
+class TrajectoryWriter {
+private:
+	int fd;
+	int every;
+	int n_chemicals;
+	long long offset; // end of the file
+	std::vector<TrajectoryIndexEntry> index;
+
+public:
+	TrajectoryWriter();
+	~TrajectoryWriter();
+
+	bool open(const char *filename, const Simulation& simulation, int every);
+	bool is_open() const { return fd != -1; }
+
+	// writes a frame of the current cells when the iteration is a multiple of 'every'
+	bool record(const Simulation& simulation);
+
+	// writes the index; false if any write failed
+	bool close();
+};
+
+// maps a trajectory file into memory, to read any frame without copying it
+class TrajectoryReader {
+private:
+	const char *data;
+	size_t      size;
+	std::vector<TrajectoryIndexEntry> index;
+
+public:
+	TrajectoryReader();
+	~TrajectoryReader();
+
+	bool open(const char *filename);
+	void close();
+
+	const TrajectoryHeader& get_header() const { return *(const TrajectoryHeader*) data; }
+	int  get_frame_count() const { return (int) index.size(); }
+	void get_frame(int f, TrajectoryFrame& frame) const;
+};
+
+#endif // TRAJECTORY_HPP
@@ -3,6 +3,7 @@
 
 /*-------------------------------- INCLUDES --------------------------------*/
 
+#include <algorithm>
 #include <cfloat>
 #include <climits>
 #include <cmath>
@@ -19,11 +20,12 @@
 
 #define INFLUENCE_RANGE 3.0
 
-#define MAX_CELLS      20000
+#define INITIAL_CELLS  1024 // cell arrays grow geometrically from here, so the number of cells is not limited
 #define MAX_CHEMICALS  10
 #define MAX_MAPPINGS   10
 #define MAX_RULES      20
 #define MAX_PARAMETERS 6
+#define MAX_NEIGHBORS  500
 
 //#define NNS_PRECISION
 
@@ -51,6 +53,266 @@ public:
 #endif // NNS_PRECISION
 };
 
+// structure-of-arrays storage for all cells: each attribute is a separate array indexed by CellId, and
+// per-chemical arrays exist only for defined chemicals, so a loop touches just the attributes it needs
+
+class CellArray {
+public:
+	int   *birth, *neighbors;
+	float *x, *y;
+	float *polarity_x, *polarity_y;
+	float *conc[MAX_CHEMICALS];
+	float *diff[MAX_CHEMICALS];
+	bool  *fixed;
+	bool  *marker; // TODO: needed only for neighborhood display
+#ifdef NNS_PRECISION
+	int   *error;
+#endif // NNS_PRECISION
+
+private:
+	int capacity;
+	int n_chemicals;
+
+public:
+	CellArray(int capacity)
+	{
+		this->capacity = capacity;
+		n_chemicals = 0;
+
+		birth = new int[capacity];
+		neighbors = new int[capacity];
+		x = new float[capacity];
+		y = new float[capacity];
+		polarity_x = new float[capacity];
+		polarity_y = new float[capacity];
+		for (int ch = 0; ch < MAX_CHEMICALS; ch++) {
+			conc[ch] = diff[ch] = NULL;
+		}
+		fixed = new bool[capacity];
+		marker = new bool[capacity];
+#ifdef NNS_PRECISION
+		error = new int[capacity];
+#endif // NNS_PRECISION
+	}
+
+	// deep copy, as needed to copy a whole simulation
+	CellArray(const CellArray& other)
+	{
+		capacity = other.capacity;
+		n_chemicals = other.n_chemicals;
+
+		birth = clone(other.birth);
+		neighbors = clone(other.neighbors);
+		x = clone(other.x);
+		y = clone(other.y);
+		polarity_x = clone(other.polarity_x);
+		polarity_y = clone(other.polarity_y);
+		for (int ch = 0; ch < MAX_CHEMICALS; ch++) {
+			conc[ch] = (ch < n_chemicals) ? clone(other.conc[ch]) : NULL;
+			diff[ch] = (ch < n_chemicals) ? clone(other.diff[ch]) : NULL;
+		}
+		fixed = clone(other.fixed);
+		marker = clone(other.marker);
+#ifdef NNS_PRECISION
+		error = clone(other.error);
+#endif // NNS_PRECISION
+	}
+
+	CellArray& operator=(const CellArray& other)
+	{
+		CellArray copy(other);
+		swap(copy);
+		return *this;
+	}
+
+	~CellArray()
+	{
+		delete[] birth;
+		delete[] neighbors;
+		delete[] x;
+		delete[] y;
+		delete[] polarity_x;
+		delete[] polarity_y;
+		for (int ch = 0; ch < n_chemicals; ch++) {
+			delete[] conc[ch];
+			delete[] diff[ch];
+		}
+		delete[] fixed;
+		delete[] marker;
+#ifdef NNS_PRECISION
+		delete[] error;
+#endif // NNS_PRECISION
+	}
+
+	// allocate arrays for one more chemical, with zero concentration and diffusion for all cells
+	void add_chemical()
+	{
+		conc[n_chemicals] = new float[capacity];
+		diff[n_chemicals] = new float[capacity];
+		std::fill(conc[n_chemicals], conc[n_chemicals] + capacity, 0.0f);
+		std::fill(diff[n_chemicals], diff[n_chemicals] + capacity, 0.0f);
+		n_chemicals++;
+	}
+
+	// gather all attributes of one cell into a record
+	void load(CellId id, Cell& cell) const
+	{
+		cell.birth = birth[id];
+		cell.neighbors = neighbors[id];
+		cell.x = x[id];
+		cell.y = y[id];
+		cell.polarity_x = polarity_x[id];
+		cell.polarity_y = polarity_y[id];
+		for (int ch = 0; ch < n_chemicals; ch++) {
+			cell.conc[ch] = conc[ch][id];
+			cell.diff[ch] = diff[ch][id];
+		}
+		cell.fixed = fixed[id];
+		cell.marker = marker[id];
+#ifdef NNS_PRECISION
+		cell.error = error[id];
+#endif // NNS_PRECISION
+	}
+
+	// scatter a record into the attributes of one cell
+	void store(CellId id, const Cell& cell)
+	{
+		birth[id] = cell.birth;
+		neighbors[id] = cell.neighbors;
+		x[id] = cell.x;
+		y[id] = cell.y;
+		polarity_x[id] = cell.polarity_x;
+		polarity_y[id] = cell.polarity_y;
+		for (int ch = 0; ch < n_chemicals; ch++) {
+			conc[ch][id] = cell.conc[ch];
+			diff[ch][id] = cell.diff[ch];
+		}
+		fixed[id] = cell.fixed;
+		marker[id] = cell.marker;
+#ifdef NNS_PRECISION
+		error[id] = cell.error;
+#endif // NNS_PRECISION
+	}
+
+	// copy all attributes of cell 'from_id' in 'from' to cell 'id'
+	void copy(CellId id, const CellArray& from, CellId from_id)
+	{
+		Cell cell;
+		from.load(from_id, cell);
+		store(id, cell);
+	}
+
+	void swap(CellArray& other)
+	{
+		std::swap(birth, other.birth);
+		std::swap(neighbors, other.neighbors);
+		std::swap(x, other.x);
+		std::swap(y, other.y);
+		std::swap(polarity_x, other.polarity_x);
+		std::swap(polarity_y, other.polarity_y);
+		std::swap(conc, other.conc);
+		std::swap(diff, other.diff);
+		std::swap(fixed, other.fixed);
+		std::swap(marker, other.marker);
+#ifdef NNS_PRECISION
+		std::swap(error, other.error);
+#endif // NNS_PRECISION
+		std::swap(capacity, other.capacity);
+		std::swap(n_chemicals, other.n_chemicals);
+	}
+
+	int get_chemical_count() const { return n_chemicals; }
+	int get_capacity() const { return capacity; }
+
+	// make room for at least 'n' cells, keeping the attributes of existing cells; the capacity at least doubles, so
+	// adding cells one at a time costs amortized constant time and no allocation once the tissue stops growing
+	void reserve(int n)
+	{
+		if (n <= capacity) {
+			return;
+		}
+		int new_capacity = std::max(n, 2 * capacity);
+		grow(birth, new_capacity);
+		grow(neighbors, new_capacity);
+		grow(x, new_capacity);
+		grow(y, new_capacity);
+		grow(polarity_x, new_capacity);
+		grow(polarity_y, new_capacity);
+		for (int ch = 0; ch < n_chemicals; ch++) {
+			grow(conc[ch], new_capacity);
+			grow(diff[ch], new_capacity);
+		}
+		grow(fixed, new_capacity);
+		grow(marker, new_capacity);
+#ifdef NNS_PRECISION
+		grow(error, new_capacity);
+#endif // NNS_PRECISION
+		capacity = new_capacity;
+	}
+
+	// renumber cells so that cell 'id' gets the attributes of cell 'order[id]'
+	void permute(const std::vector<int>& order)
+	{
+		gather(birth, order);
+		gather(neighbors, order);
+		gather(x, order);
+		gather(y, order);
+		gather(polarity_x, order);
+		gather(polarity_y, order);
+		for (int ch = 0; ch < n_chemicals; ch++) {
+			gather(conc[ch], order);
+			gather(diff[ch], order);
+		}
+		gather(fixed, order);
+		gather(marker, order);
+#ifdef NNS_PRECISION
+		gather(error, order);
+#endif // NNS_PRECISION
+	}
+
+	// bytes taken by the attributes of the first 'n_cells' cells
+	size_t get_used_memory(int n_cells) const
+	{
+		size_t bytes = 2 * sizeof(int) + 4 * sizeof(float) + 2 * n_chemicals * sizeof(float) + 2 * sizeof(bool);
+#ifdef NNS_PRECISION
+		bytes += sizeof(int);
+#endif // NNS_PRECISION
+		return bytes * n_cells;
+	}
+
+private:
+	// copy of one attribute array
+	template <class T>
+	T *clone(const T *values) const
+	{
+		T *copy = new T[capacity];
+		std::copy(values, values + capacity, copy);
+		return copy;
+	}
+
+	// reallocate one attribute array, new cells are zeroed
+	template <class T>
+	void grow(T*& values, int new_capacity)
+	{
+		T *resized = new T[new_capacity];
+		std::copy(values, values + capacity, resized);
+		std::fill(resized + capacity, resized + new_capacity, T());
+		delete[] values;
+		values = resized;
+	}
+
+	template <class T>
+	void gather(T*& values, const std::vector<int>& order)
+	{
+		T *permuted = new T[capacity];
+		for (int id = 0; id < (int) order.size(); id++) {
+			permuted[id] = values[order[id]];
+		}
+		delete[] values;
+		values = permuted;
+	}
+};
+
 class Chemical {
 public:
     std::string name;
@@ -180,6 +442,37 @@ public:
 		}
 	}
 
+	// combine partial statistics gathered over a disjoint set of cells (e.g. by another thread)
+	void merge(const Statistics& other, int n_chemicals)
+	{
+		if (other.is_first) {
+			return;
+		}
+		if (is_first) {
+			*this = other;
+			return;
+		}
+
+		if (other.cell_xmin < cell_xmin) { cell_xmin = other.cell_xmin; }
+		if (other.cell_xmax > cell_xmax) { cell_xmax = other.cell_xmax; }
+
+		if (other.cell_ymin < cell_ymin) { cell_ymin = other.cell_ymin; }
+		if (other.cell_ymax > cell_ymax) { cell_ymax = other.cell_ymax; }
+
+		if (other.cell_nmin < cell_nmin) { cell_nmin = other.cell_nmin; }
+		if (other.cell_nmax > cell_nmax) { cell_nmax = other.cell_nmax; }
+		sum_neighbors += other.sum_neighbors;
+
+		for (int c = 0; c < n_chemicals; c++) {
+			if (other.chem_min[c] < chem_min[c]) { chem_min[c] = other.chem_min[c]; }
+			if (other.chem_max[c] > chem_max[c]) { chem_max[c] = other.chem_max[c]; }
+		}
+
+#ifdef NNS_PRECISION
+		if (other.error_max > error_max) { error_max = other.error_max; }
+#endif // NNS_PRECISION
+	}
+
 	void finish(int n_cells)
 	{
 		cell_navg = (float) sum_neighbors / n_cells;
@@ -202,9 +495,11 @@ public:
 	bool  is_running;
 	int   iteration;
 	float time_step;
+	int   seed;
+	int   n_threads;
 
-    Cell *curr_cells;
-    Cell *next_cells;
+    CellArray curr_cells;
+    CellArray next_cells;
 
     Chemical chemicals[MAX_CHEMICALS];
 
@@ -213,7 +508,6 @@ public:
     std::vector<Rule> rules;
 
     std::vector<std::string> mappings;
-    float curr_mappings[MAX_MAPPINGS];
 
     std::vector<std::pair<CellId,CellId> > mirror_list;
     bool mirroring;
@@ -228,7 +522,7 @@ public:
     bool is_stable;
 
 public:
-	Simulation()
+	Simulation() : curr_cells(INITIAL_CELLS), next_cells(INITIAL_CELLS)
 	{
 		n_cells = 0;
 		n_chemicals = 0;
@@ -240,11 +534,10 @@ public:
 		is_running = true;
 		iteration = 0;
 		time_step = 1.0;
+		seed = 1; // same as the default seed of rand()
+		n_threads = 1;
 		division_limit = 0;
 
-        curr_cells = new Cell[MAX_CELLS];
-        next_cells = new Cell[MAX_CELLS];
-
         tracked_id = (CellId) -1;
 
         mirroring = false;
@@ -258,18 +551,11 @@ public:
 	    is_stable = false;
 	}
 
-    ~Simulation()
-    {
-        delete[] curr_cells;
-        delete[] next_cells;
-    }
-
+    // storage may be reallocated, so pointers into 'curr_cells' and 'next_cells' are not valid after this call
     CellId new_cell()
     {
-    	if (n_cells >= MAX_CELLS) {
-    		std::cout << "error: no more cells available (max " << MAX_CELLS << ")\n";
-    		return (CellId) -1;
-    	}
+    	curr_cells.reserve(n_cells + 1);
+    	next_cells.reserve(n_cells + 1);
     	CellId id = (CellId) n_cells;
     	n_cells++;
     	return id;
@@ -283,14 +569,14 @@ public:
     	}
     	int ch = n_chemicals;
     	n_chemicals++;
+    	curr_cells.add_chemical();
+    	next_cells.add_chemical();
     	return ch;
     }
 
     void swap_cells()
     {
-        Cell *temp = curr_cells;
-        curr_cells = next_cells;
-        next_cells = temp;
+        curr_cells.swap(next_cells);
     }
 };
 
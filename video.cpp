@@ -0,0 +1,94 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cstring>
+
+#include "video.hpp"
+
+/*-------------------------------- LOCAL FUNCTIONS --------------------------------*/
+
+static unsigned char clamp(int value)
+{
+	return (value < 0) ? 0 : (value > 255) ? 255 : value;
+}
+
+/*-------------------------------- VIDEO WRITER METHODS --------------------------------*/
+
+VideoWriter::VideoWriter()
+{
+	file = NULL;
+	format = VIDEO_RAW;
+	width = height = 0;
+	n_frames = 0;
+}
+
+VideoWriter::~VideoWriter()
+{
+	close();
+}
+
+bool VideoWriter::open(const char *filename, int width, int height, int fps)
+{
+	close();
+
+	int length = strlen(filename);
+	format = (length >= 4 && strcmp(filename + length - 4, ".y4m") == 0) ? VIDEO_Y4M : VIDEO_RAW;
+	file = (strcmp(filename, "-") == 0) ? stdout : fopen(filename, "wb");
+	if (!file) {
+		return false;
+	}
+	this->width = width;
+	this->height = height;
+	n_frames = 0;
+	buffer.resize(width * height * 3);
+
+	if (format == VIDEO_Y4M) {
+		fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, fps);
+	}
+	return !ferror(file);
+}
+
+bool VideoWriter::write(const unsigned char *pixels)
+{
+	if (!file) {
+		return false;
+	}
+
+	int row_size = width * 3;
+	if (format == VIDEO_RAW) {
+		for (int r = 0; r < height; r++) {
+			memcpy(&buffer[r * row_size], &pixels[(height - 1 - r) * row_size], row_size);
+		}
+	}
+	else {
+		// planes of Y, Cb and Cr from the top, with studio range BT.601 coefficients in 8-bit fixed point
+		int n_pixels = width * height;
+		unsigned char *y = &buffer[0], *cb = y + n_pixels, *cr = cb + n_pixels;
+		for (int r = 0; r < height; r++) {
+			const unsigned char *rgb = &pixels[(height - 1 - r) * row_size];
+			for (int c = 0; c < width; c++, rgb += 3) {
+				int red = rgb[0], green = rgb[1], blue = rgb[2];
+				*y++  = clamp((( 66 * red + 129 * green +  25 * blue + 128) >> 8) +  16);
+				*cb++ = clamp(((-38 * red -  74 * green + 112 * blue + 128) >> 8) + 128);
+				*cr++ = clamp(((112 * red -  94 * green -  18 * blue + 128) >> 8) + 128);
+			}
+		}
+		fputs("FRAME\n", file);
+	}
+	fwrite(&buffer[0], 1, buffer.size(), file);
+	fflush(file);
+	n_frames++;
+	return !ferror(file);
+}
+
+bool VideoWriter::close()
+{
+	if (!file) {
+		return true;
+	}
+	bool ok = (fflush(file) == 0) && !ferror(file);
+	if (file != stdout) {
+		ok = (fclose(file) == 0) && ok;
+	}
+	file = NULL;
+	return ok;
+}
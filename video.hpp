@@ -0,0 +1,45 @@
+#ifndef VIDEO_HPP
+#define VIDEO_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cstdio>
+#include <vector>
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+// Y4M holds 8-bit 4:4:4 YCbCr frames after a one-line header, and is read as is by most encoders; raw frames are
+// RGB24 rows from the top, for encoders told the size and format on their command line
+enum VideoFormat {VIDEO_Y4M, VIDEO_RAW};
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// writes frames of a fixed size one after the other into a single uncompressed stream
+class VideoWriter {
+private:
+	FILE *file;
+	VideoFormat format;
+	int width, height;
+	int n_frames;
+	std::vector<unsigned char> buffer; // one converted frame
+
+public:
+	VideoWriter();
+	~VideoWriter();
+
+	// "-" writes to the standard output; the format is Y4M for names ending in .y4m, raw otherwise
+	bool open(const char *filename, int width, int height, int fps = 25);
+	bool is_open() const { return file != NULL; }
+
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+	int get_frame_count() const { return n_frames; }
+
+	// 'pixels' holds width * height RGB values, the first row being the bottom of the frame as for export_png
+	bool write(const unsigned char *pixels);
+
+	// false if any write failed
+	bool close();
+};
+
+#endif // VIDEO_HPP
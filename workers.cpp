@@ -0,0 +1,125 @@
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <cstdlib>
+#include <iostream>
+
+#include "workers.hpp"
+
+/*-------------------------------- LOCAL TYPES --------------------------------*/
+
+struct WorkerStart {
+	WorkerPool *pool;
+	int         thread;
+};
+
+/*-------------------------------- CONSTRUCTOR AND DESTRUCTOR --------------------------------*/
+
+WorkerPool::WorkerPool(int n_threads)
+{
+	if (n_threads < 1) {
+		n_threads = 1;
+	}
+	this->n_threads = n_threads;
+
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&start_cond, NULL);
+	pthread_cond_init(&done_cond, NULL);
+
+	task = NULL;
+	data = NULL;
+	generation = 0;
+	pending = 0;
+	quit = false;
+
+	// thread 0 is the caller of run(), so only the remaining threads are created
+	threads.resize(n_threads - 1);
+	for (int t = 1; t < n_threads; t++) {
+		WorkerStart *start = new WorkerStart;
+		start->pool = this;
+		start->thread = t;
+		if (pthread_create(&threads[t - 1], NULL, worker_main, start) != 0) {
+			std::cerr << "error: cannot create worker thread " << t << '\n';
+			exit(1);
+		}
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	pthread_mutex_lock(&mutex);
+	quit = true;
+	generation++;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&mutex);
+
+	for (int t = 0; t < (int) threads.size(); t++) {
+		pthread_join(threads[t], NULL);
+	}
+
+	pthread_cond_destroy(&done_cond);
+	pthread_cond_destroy(&start_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+/*-------------------------------- PUBLIC METHOD IMPLEMENTATIONS --------------------------------*/
+
+void WorkerPool::run(WorkerTask task, void *data)
+{
+	if (n_threads == 1) {
+		// nothing to synchronize
+		task(0, 1, data);
+		return;
+	}
+
+	pthread_mutex_lock(&mutex);
+	this->task = task;
+	this->data = data;
+	pending = n_threads - 1;
+	generation++;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&mutex);
+
+	task(0, n_threads, data);
+
+	pthread_mutex_lock(&mutex);
+	while (pending > 0) {
+		pthread_cond_wait(&done_cond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+/*-------------------------------- PRIVATE METHOD IMPLEMENTATIONS --------------------------------*/
+
+void *WorkerPool::worker_main(void *arg)
+{
+	WorkerStart *start = (WorkerStart *) arg;
+	WorkerPool *pool = start->pool;
+	int thread = start->thread;
+	delete start;
+
+	int seen = 0;
+	while (true) {
+		pthread_mutex_lock(&pool->mutex);
+		while (pool->generation == seen) {
+			pthread_cond_wait(&pool->start_cond, &pool->mutex);
+		}
+		seen = pool->generation;
+		if (pool->quit) {
+			pthread_mutex_unlock(&pool->mutex);
+			break;
+		}
+		WorkerTask task = pool->task;
+		void *data = pool->data;
+		pthread_mutex_unlock(&pool->mutex);
+
+		task(thread, pool->n_threads, data);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->pending--;
+		if (pool->pending == 0) {
+			pthread_cond_signal(&pool->done_cond);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+	}
+	return NULL;
+}
@@ -0,0 +1,53 @@
+#ifndef WORKERS_HPP
+#define WORKERS_HPP
+
+/*-------------------------------- INCLUDES --------------------------------*/
+
+#include <pthread.h>
+
+#include <vector>
+
+/*-------------------------------- TYPE DEFINITIONS --------------------------------*/
+
+// task executed by every thread of the pool; 'thread' goes from 0 to 'n_threads' - 1
+typedef void (*WorkerTask)(int thread, int n_threads, void *data);
+
+/*-------------------------------- CLASSES --------------------------------*/
+
+// fixed set of threads that run the same task in lockstep; the calling thread takes part as thread 0
+class WorkerPool {
+private:
+	int n_threads;
+	std::vector<pthread_t> threads;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t  start_cond;
+	pthread_cond_t  done_cond;
+
+	WorkerTask task;
+	void      *data;
+	int        generation; // incremented for each task, so workers can tell a new task from a spurious wakeup
+	int        pending;    // number of workers still running the current task
+	bool       quit;
+
+public:
+	WorkerPool(int n_threads);
+	~WorkerPool();
+
+	int get_thread_count() const { return n_threads; }
+
+	// run 'task' on all threads and return only after every thread has finished it
+	void run(WorkerTask task, void *data);
+
+	// contiguous share [begin, end) of 'n' items that belongs to 'thread'
+	static void split(int n, int thread, int n_threads, int& begin, int& end)
+	{
+		begin = (int) ((long long) n * thread / n_threads);
+		end   = (int) ((long long) n * (thread + 1) / n_threads);
+	}
+
+private:
+	static void *worker_main(void *arg);
+};
+
+#endif // WORKERS_HPP